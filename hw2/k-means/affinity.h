@@ -0,0 +1,173 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sched.h>
+
+#include "omp.h"
+
+/*
+    Thread placement on NUMA machines. PinThreads binds every OpenMP thread to
+    one allowed CPU, either compact (socket after socket) or scatter (round
+    robin over sockets), and remembers socket of every thread. OpenMP keeps
+    the same threads for later parallel regions of the same size, so binding
+    holds for the whole run. SocketReplicas keeps one copy of small read-only
+    data, such as centroids, on every socket used by pinned threads.
+*/
+
+struct ThreadPlacement {
+    ThreadPlacement() : sockets(1), replicate(false) {
+    }
+
+    std::vector<size_t> thread_sockets;  // dense socket index of pinned threads
+    size_t sockets;
+    bool replicate;  // SocketReplicas keep copy per socket
+};
+
+inline ThreadPlacement& GetThreadPlacement() {
+    static ThreadPlacement placement;
+    return placement;
+}
+
+// Socket of the thread with given OpenMP number, 0 unless threads are pinned
+inline size_t ThreadSocket(size_t thread) {
+    const ThreadPlacement& placement = GetThreadPlacement();
+    return thread < placement.thread_sockets.size() ? placement.thread_sockets[thread] : 0;
+}
+
+// Physical package of cpu, 0 when topology is not exposed
+inline int CpuSocket(int cpu) {
+    std::ostringstream path;
+    path << "/sys/devices/system/cpu/cpu" << cpu << "/topology/physical_package_id";
+    std::ifstream input(path.str().c_str());
+    int socket = 0;
+    if (!(input >> socket)) {
+        return 0;
+    }
+    return socket;
+}
+
+// Binds omp_get_max_threads() threads by policy none, compact or scatter.
+// Threads beyond the number of allowed CPUs wrap around. Prints error and
+// returns false on failure.
+inline bool PinThreads(const std::string& policy) {
+    if (policy == "none") {
+        return true;
+    }
+    if (policy != "compact" && policy != "scatter") {
+        std::cerr << "Error: unknown binding policy " << policy << std::endl;
+        return false;
+    }
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        std::cerr << "Error: allowed CPUs could not be read" << std::endl;
+        return false;
+    }
+    // Allowed CPUs grouped by socket, sockets numbered in order of appearance
+    std::vector<int> socket_ids;
+    std::vector<std::vector<int> > socket_cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (!CPU_ISSET(cpu, &allowed)) {
+            continue;
+        }
+        int id = CpuSocket(cpu);
+        size_t socket = 0;
+        while (socket < socket_ids.size() && socket_ids[socket] != id) {
+            ++socket;
+        }
+        if (socket == socket_ids.size()) {
+            socket_ids.push_back(id);
+            socket_cpus.push_back(std::vector<int>());
+        }
+        socket_cpus[socket].push_back(cpu);
+    }
+
+    std::vector<int> cpus;
+    std::vector<size_t> cpu_sockets;
+    if (policy == "compact") {
+        for (size_t socket = 0; socket < socket_cpus.size(); ++socket) {
+            for (size_t c = 0; c < socket_cpus[socket].size(); ++c) {
+                cpus.push_back(socket_cpus[socket][c]);
+                cpu_sockets.push_back(socket);
+            }
+        }
+    } else {
+        for (size_t round = 0; cpus.size() < static_cast<size_t>(CPU_COUNT(&allowed)); ++round) {
+            for (size_t socket = 0; socket < socket_cpus.size(); ++socket) {
+                if (round < socket_cpus[socket].size()) {
+                    cpus.push_back(socket_cpus[socket][round]);
+                    cpu_sockets.push_back(socket);
+                }
+            }
+        }
+    }
+
+    ThreadPlacement& placement = GetThreadPlacement();
+    size_t threads = omp_get_max_threads();
+    placement.thread_sockets.assign(threads, 0);
+    placement.sockets = socket_ids.size();
+    bool ok = true;
+    #pragma omp parallel num_threads(threads)
+    {
+        size_t thread = omp_get_thread_num();
+        size_t slot = thread % cpus.size();
+        cpu_set_t cpu;
+        CPU_ZERO(&cpu);
+        CPU_SET(cpus[slot], &cpu);
+        if (sched_setaffinity(0, sizeof(cpu), &cpu) != 0) {
+            #pragma omp atomic write
+            ok = false;
+        }
+        placement.thread_sockets[thread] = cpu_sockets[slot];
+    }
+    if (!ok) {
+        std::cerr << "Error: threads could not be pinned" << std::endl;
+    }
+    return ok;
+}
+
+// Copy of X per socket of pinned threads when replication is enabled and
+// a single copy otherwise. Both members are called by every thread of
+// a parallel region.
+template <class X>
+class SocketReplicas {
+public:
+    SocketReplicas() : copies_(1) {
+    }
+
+    // First thread of every socket runs load(X*) on copy of its socket, so
+    // the copy is first touched there, then the team waits for all copies
+    template <class Loader>
+    void Load(Loader load) {
+        const ThreadPlacement& placement = GetThreadPlacement();
+        #pragma omp single
+        copies_.resize(placement.replicate ? placement.sockets : 1);
+        size_t thread = omp_get_thread_num();
+        size_t socket = Socket(thread);
+        bool first = true;
+        for (size_t other = 0; other < thread; ++other) {
+            first &= Socket(other) != socket;
+        }
+        if (first) {
+            load(&copies_[socket]);
+        }
+        #pragma omp barrier
+    }
+
+    const X& Local() const {
+        return copies_[Socket(omp_get_thread_num())];
+    }
+
+private:
+    size_t Socket(size_t thread) const {
+        return copies_.size() > 1 ? ThreadSocket(thread) : 0;
+    }
+
+    std::vector<X> copies_;
+};
+
+#endif
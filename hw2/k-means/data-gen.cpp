@@ -1,105 +1,114 @@
-#include <cmath>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string>
 #include <vector>
+#include <getopt.h>
 #include <time.h>
 
-using namespace std;
-
-typedef vector<double> Point;
-
-// Pretty good uniform distribution on [0..1]
-double RandUniform01() {
-    int rand1 = rand();
-    double div = RAND_MAX;
-    while (rand1 == RAND_MAX) {
-        rand1 = rand();
-    }
-    return ((double)rand1 + rand() / div) / div;
-}
-
-// Box-Muller transform
-double RandNormal(double mean, double sigma) {
-    double x, y, r;
-    do {  
-        x = 2 * RandUniform01() - 1;
-        y = 2 * RandUniform01() - 1;
-        r = x * x + y * y;
-    } while (r == 0.0 || r > 1.0);
-    return sigma * x * sqrt(-2 * log(r) / r) + mean;
-}
+#include "data-gen.h"
+#include "points.h"
 
-struct ClusterParams {
-    Point mean;
-    double var;
-};
+using namespace std;
 
-Point RandomPointGauss(ClusterParams params) {
-    size_t dimensions = params.mean.size();
-    Point coord(dimensions);
-    for (size_t i = 0; i < dimensions; ++i) {
-        coord[i] = RandNormal(params.mean[i], params.var);
-    }
-    return coord;
+// Points generated and written at once, bounds memory for huge sets
+const size_t kBlockPoints = 1 << 18;
+
+void PrintUsage(const char* program) {
+    cerr << "Usage: " << program << " [options] dimensions number_of_points number_of_clusters"
+         << " output_file [text|float32|float64]" << endl;
+    cerr << "Options:" << endl;
+    cerr << "  --seed=N                same seed gives the same points with any threads" << endl;
+    cerr << "                          number (default: current time)" << endl;
+    cerr << "  --labels=FILE           write ground-truth cluster of every point one per" << endl;
+    cerr << "                          line, noise points get number_of_clusters" << endl;
 }
 
-Point RandomPointUniform(size_t dimensions, double space_size) {
-    Point coord(dimensions);
-    for (size_t i = 0; i < dimensions; ++i) {
-        coord[i] = RandUniform01() * space_size;
+int main(int argc , char** argv) {
+    uint64_t seed = time(0);
+    string labels_file;
+
+    static const struct option long_options[] = {
+        {"seed", required_argument, nullptr, 's'},
+        {"labels", required_argument, nullptr, 'l'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (option) {
+            case 's':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'l':
+                labels_file = optarg;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
     }
-    return coord;
-}
-
-void WritePoint(Point point, ofstream& out) {
-    for (size_t i = 0; i < point.size()-1; ++i) {
-        out << point[i] << " ";
+    if (argc - optind != 4 && argc - optind != 5) {
+        PrintUsage(argv[0]);
+        return 1;
     }
-    out << point[point.size()-1] << endl;
-}
-
-int main(int argc , char** argv) {
-    if (argc != 5) {
-        cerr << "Usage: " << argv[0] << " dimensions number_of_points number_of_clusters output_file" << endl;
+    argv += optind;
+    size_t dimensions = atoi(argv[0]);
+    size_t number_of_points = atoi(argv[1]);
+    size_t number_of_clusters = atoi(argv[2]);
+
+    string format = (argc - optind == 5) ? argv[4] : "text";
+    bool binary = (format != "text");
+    PointsType type = (format == "float32") ? FLOAT32 : FLOAT64;
+    if (binary && format != "float32" && format != "float64") {
+        cerr << "Error: unknown output format " << format << endl;
         return 1;
     }
-    size_t dimensions = atoi(argv[1]);
-    size_t number_of_points = atoi(argv[2]);
-    size_t number_of_clusters = atoi(argv[3]); // 0..32767
 
-    string output_file = argv[4];
-    ofstream output(output_file);
+    ofstream output(argv[3], ofstream::binary);
     if(!output.is_open()) {
         cerr << "Error: output file could not be opened" << endl;
         return 1;
     }
+    ofstream labels_output;
+    if (!labels_file.empty()) {
+        labels_output.open(labels_file.c_str());
+        if (!labels_output) {
+            cerr << "Error: labels file could not be opened" << endl;
+            return 1;
+        }
+    }
 
-    // advanced params
-    double space_size = 100;
-    double cluster_size = 5;
-    int random_point_pct = 20;
-
-    srand((unsigned)time(0));
+    GeneratorParams params;
+    vector<ClusterParams> cluster_params = RandomClusters(dimensions, number_of_clusters, seed, params);
 
-    vector<ClusterParams> cluster_params(number_of_clusters);
-    for (size_t i = 0; i < number_of_clusters; ++i) {
-        cluster_params[i].mean = RandomPointUniform(dimensions, space_size);
-        cluster_params[i].var = cluster_size / 2 + RandUniform01() * cluster_size;
+    if (binary) {
+        WritePointsHeader(output, number_of_points, dimensions, type);
+    } else {
+        output << number_of_points << " " << dimensions << "\n";
     }
 
-    output << number_of_points << " " << dimensions << endl;
-
-    for (size_t i = 0; i < number_of_points; ++i) {
-        bool in_cluster = (rand() % 100) >= random_point_pct;
-        if (in_cluster) {
-            size_t cluster = rand() % number_of_clusters;
-            WritePoint(RandomPointGauss(cluster_params[cluster]), output);
+    Points block;
+    vector<size_t> labels;
+    for (size_t first = 0; first < number_of_points; first += kBlockPoints) {
+        block.Assign(std::min(kBlockPoints, number_of_points - first), dimensions);
+        GeneratePointsRange(cluster_params, seed, first, params, &block,
+                            labels_output.is_open() ? &labels : nullptr);
+        if (binary) {
+            WriteBinaryPoints(output, block, type);
         } else {
-            WritePoint(RandomPointUniform(dimensions, space_size), output);
+            WriteTextPoints(block, output);
+        }
+        if (labels_output.is_open()) {
+            WriteLabels(labels, labels_output);
         }
     }
 
-    output.close();  
+    output.close();
+    if (!output) {
+        cerr << "Error: output file could not be written" << endl;
+        return 1;
+    }
     return 0;
 }
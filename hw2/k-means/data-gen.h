@@ -0,0 +1,153 @@
+#ifndef DATA_GEN_H
+#define DATA_GEN_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+#include "omp.h"
+#include "points.h"
+#include "random.h"
+
+/*
+    Synthetic points for k-means: gaussian clusters with random centres in
+    [0, space_size]^dimensions plus uniformly scattered noise points. Used
+    by data-gen to write files and by kmeans-bench to generate in memory.
+
+    Random numbers are counter-based: every point draws from its own stream
+    keyed by (seed, point index), so points are generated in parallel in any
+    order and the output depends only on the seed, not on threads number.
+*/
+
+// Sequence of HashRandom values of one stream
+class RandomStream {
+public:
+    RandomStream(uint64_t seed, uint64_t stream)
+        : seed_(seed), stream_(stream), counter_(0) {
+    }
+
+    uint64_t Next() {
+        return HashRandom(seed_, stream_, counter_++);
+    }
+
+    // Uniform on [0, 1) with 53 random bits
+    double Uniform01() {
+        return (Next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform on [0, n)
+    size_t Below(size_t n) {
+        return Next() % n;
+    }
+
+    // Box-Muller transform in the basic form: two independent normal numbers
+    // from two uniforms, without rejection loop of the polar form
+    void Normal2(double* first, double* second) {
+        double radius = std::sqrt(-2 * std::log(1 - Uniform01()));
+        double angle = 2 * M_PI * Uniform01();
+        *first = radius * std::cos(angle);
+        *second = radius * std::sin(angle);
+    }
+
+private:
+    uint64_t seed_;
+    uint64_t stream_;
+    uint64_t counter_;
+};
+
+// Stream of cluster parameters, point streams use indices below it
+const uint64_t kClustersStream = ~0ULL;
+
+struct ClusterParams {
+    std::vector<double> mean;
+    double var;
+};
+
+inline void RandomPointGauss(const ClusterParams& params, RandomStream* random, double* coord) {
+    size_t dimensions = params.mean.size();
+    double second;
+    for (size_t i = 0; i < dimensions; i += 2) {
+        random->Normal2(&coord[i], &second);
+        coord[i] = coord[i] * params.var + params.mean[i];
+        if (i + 1 < dimensions) {
+            coord[i + 1] = second * params.var + params.mean[i + 1];
+        }
+    }
+}
+
+inline void RandomPointUniform(size_t dimensions, double space_size, RandomStream* random,
+                               double* coord) {
+    for (size_t i = 0; i < dimensions; ++i) {
+        coord[i] = random->Uniform01() * space_size;
+    }
+}
+
+struct GeneratorParams {
+    GeneratorParams()
+        : space_size(100), cluster_size(5), random_point_pct(20) {
+    }
+
+    double space_size;
+    double cluster_size;
+    int random_point_pct;  // share of noise points
+};
+
+inline std::vector<ClusterParams> RandomClusters(size_t dimensions, size_t number_of_clusters,
+                                                 uint64_t seed, const GeneratorParams& params) {
+    RandomStream random(seed, kClustersStream);
+    std::vector<ClusterParams> cluster_params(number_of_clusters);
+    for (size_t i = 0; i < number_of_clusters; ++i) {
+        cluster_params[i].mean.resize(dimensions);
+        RandomPointUniform(dimensions, params.space_size, &random, cluster_params[i].mean.data());
+        cluster_params[i].var = params.cluster_size / 2 + random.Uniform01() * params.cluster_size;
+    }
+    return cluster_params;
+}
+
+// Generates point number index into coord and returns its cluster, noise
+// points are labelled with number of clusters
+inline size_t RandomPoint(const std::vector<ClusterParams>& cluster_params, size_t dimensions,
+                          uint64_t seed, size_t index, const GeneratorParams& params, double* coord) {
+    RandomStream random(seed, index);
+    bool in_cluster = random.Below(100) >= static_cast<size_t>(params.random_point_pct);
+    if (in_cluster && !cluster_params.empty()) {
+        size_t cluster = random.Below(cluster_params.size());
+        RandomPointGauss(cluster_params[cluster], &random, coord);
+        return cluster;
+    }
+    RandomPointUniform(dimensions, params.space_size, &random, coord);
+    return cluster_params.size();
+}
+
+// Generates points first, ..., first + data->Size() - 1 in parallel into
+// ROW_MAJOR data, labels are stored when requested
+inline void GeneratePointsRange(const std::vector<ClusterParams>& cluster_params, uint64_t seed,
+                                size_t first, const GeneratorParams& params, Points* data,
+                                std::vector<size_t>* labels = nullptr) {
+    size_t count = data->Size();
+    size_t dimensions = data->Dimensions();
+    if (labels != nullptr) {
+        labels->resize(count);
+    }
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < count; ++i) {
+        size_t cluster = RandomPoint(cluster_params, dimensions, seed, first + i, params, data->Row(i));
+        if (labels != nullptr) {
+            (*labels)[i] = cluster;
+        }
+    }
+}
+
+// Generates points in memory, sequence is defined by the seed only
+inline Points GeneratePoints(size_t dimensions, size_t number_of_points, size_t number_of_clusters,
+                             uint64_t seed, const GeneratorParams& params = GeneratorParams(),
+                             std::vector<size_t>* labels = nullptr) {
+    std::vector<ClusterParams> cluster_params = RandomClusters(dimensions, number_of_clusters,
+                                                               seed, params);
+    Points data(number_of_points, dimensions);
+    GeneratePointsRange(cluster_params, seed, 0, params, &data, labels);
+    return data;
+}
+
+#endif
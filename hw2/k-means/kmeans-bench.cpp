@@ -0,0 +1,314 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "data-gen.h"
+#include "kmeans.h"
+#include "points.h"
+
+using namespace std;
+
+/*
+    Benchmark of kmeans phases on data generated in memory. Sweeps over all
+    combinations of points number, clusters number, dimensions, threads
+    number and engine; every combination is run warmup times untimed and
+    then repetitions times, medians are reported. Phases are seeding (init),
+    assignment, centroids update and writing labels (io).
+*/
+
+struct BenchmarkRun {
+    size_t iterations;
+    double init_time;
+    double assign_time;
+    double update_time;
+    double io_time;
+    double time;
+};
+
+// Parses comma separated list of numbers and ranges, e.g. "1,2,8-12"
+bool ParseList(const string& text, vector<size_t>* values) {
+    values->clear();
+    size_t begin = 0;
+    while (begin < text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == string::npos) {
+            end = text.size();
+        }
+        string item = text.substr(begin, end - begin);
+        size_t dash = item.find('-');
+        char* parsed_end;
+        size_t first = strtoul(item.c_str(), &parsed_end, 10);
+        size_t last = first;
+        if (dash != string::npos) {
+            last = strtoul(item.c_str() + dash + 1, &parsed_end, 10);
+        }
+        if (item.empty() || *parsed_end != '\0' || last < first) {
+            return false;
+        }
+        for (size_t value = first; value <= last; ++value) {
+            values->push_back(value);
+        }
+        begin = end + 1;
+    }
+    return !values->empty();
+}
+
+vector<string> SplitList(const string& text) {
+    vector<string> items;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = std::min(text.find(',', begin), text.size());
+        items.push_back(text.substr(begin, end - begin));
+        begin = end + 1;
+    }
+    return items;
+}
+
+double Median(vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+bool RunOnce(const Points& data, size_t K, const string& engine, const string& init, uint64_t seed,
+             const StoppingCriteria& criteria, const char* output_file, BenchmarkRun* run) {
+    double start_time = omp_get_wtime();
+    srand(seed);
+    Points centroids;
+    if (!SeedCentroids(data, K, init, seed, &centroids)) {
+        return false;
+    }
+    double seeded_time = omp_get_wtime();
+    std::unique_ptr<AssignmentStep<double, double> > step(
+        CreateAssignmentStep<double, double>(engine, data, K));
+    if (!step) {
+        cerr << "Error: unknown engine " << engine << endl;
+        return false;
+    }
+    KMeansResult result = KMeans(data, std::move(centroids), step.get(), criteria, seed);
+    double clustered_time = omp_get_wtime();
+    ofstream output(output_file);
+    if (!output) {
+        cerr << "Error: output file could not be opened" << endl;
+        return false;
+    }
+    WriteLabels(result.clusters, output);
+    output.close();
+    double end_time = omp_get_wtime();
+
+    run->iterations = result.iterations;
+    run->init_time = seeded_time - start_time;
+    run->assign_time = result.assign_time;
+    run->update_time = result.update_time;
+    run->io_time = end_time - clustered_time;
+    run->time = end_time - start_time;
+    return true;
+}
+
+void PrintUsage(const char* program) {
+    std::printf("Usage: %s [options]\n", program);
+    std::printf("Lists are comma separated numbers or ranges, e.g. 1,2,8-12\n");
+    std::printf("Options:\n");
+    std::printf("  --points=LIST           numbers of points (default: 50000)\n");
+    std::printf("  --clusters=LIST         numbers of clusters, also used to generate\n");
+    std::printf("                          data (default: 50)\n");
+    std::printf("  --dimensions=LIST       numbers of dimensions (default: 5)\n");
+    std::printf("  --threads=LIST          numbers of threads (default: OpenMP default)\n");
+    std::printf("  --engines=NAMES         comma separated engines (default: auto)\n");
+    std::printf("  --init=METHOD           centroids seeding method (default: random)\n");
+    std::printf("  --seed=N                random seed of data and seeding (default: 123)\n");
+    std::printf("  --max-iterations=N      iterations limit (default: 100)\n");
+    std::printf("  --warmup=N              untimed runs of every combination (default: 1)\n");
+    std::printf("  --repetitions=N         timed runs of every combination (default: 3)\n");
+    std::printf("  --bind=none|compact|scatter\n");
+    std::printf("                          pin threads of every threads number, see kmeans\n");
+    std::printf("                          (default: none)\n");
+    std::printf("  --replicate-centroids   with --bind, copy centroids to every socket\n");
+    std::printf("  --output=FILE           labels are written there (default: /dev/null)\n");
+    std::printf("  --format=full|threads|report\n");
+    std::printf("                          full prints all phases, threads prints\n");
+    std::printf("                          THREADS_NUMBER, TIME and report prints\n");
+    std::printf("                          POINTS_NUMBER, CLUSTERS_NUMBER, THREADS_NUMBER,\n");
+    std::printf("                          TIME as read by plotReport.R (default: full)\n");
+}
+
+int main(int argc, char** argv) {
+    vector<size_t> points_numbers(1, 50000);
+    vector<size_t> clusters_numbers(1, 50);
+    vector<size_t> dimensions_numbers(1, 5);
+    vector<size_t> threads_numbers(1, omp_get_max_threads());
+    vector<string> engines(1, "auto");
+    string init = "random";
+    uint64_t seed = 123;
+    StoppingCriteria criteria;
+    size_t warmup = 1;
+    size_t repetitions = 3;
+    string output_file = "/dev/null";
+    string format = "full";
+    string bind = "none";
+
+    static const struct option long_options[] = {
+        {"points", required_argument, nullptr, 'p'},
+        {"clusters", required_argument, nullptr, 'c'},
+        {"dimensions", required_argument, nullptr, 'd'},
+        {"threads", required_argument, nullptr, 't'},
+        {"engines", required_argument, nullptr, 'e'},
+        {"init", required_argument, nullptr, 's'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"max-iterations", required_argument, nullptr, 'i'},
+        {"warmup", required_argument, nullptr, 'w'},
+        {"repetitions", required_argument, nullptr, 'r'},
+        {"output", required_argument, nullptr, 'o'},
+        {"format", required_argument, nullptr, 'f'},
+        {"bind", required_argument, nullptr, 'b'},
+        {"replicate-centroids", no_argument, nullptr, 'R'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int option;
+    bool lists_valid = true;
+    while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (option) {
+            case 'p':
+                lists_valid &= ParseList(optarg, &points_numbers);
+                break;
+            case 'c':
+                lists_valid &= ParseList(optarg, &clusters_numbers);
+                break;
+            case 'd':
+                lists_valid &= ParseList(optarg, &dimensions_numbers);
+                break;
+            case 't':
+                lists_valid &= ParseList(optarg, &threads_numbers);
+                break;
+            case 'e':
+                engines = SplitList(optarg);
+                break;
+            case 's':
+                init = optarg;
+                break;
+            case 'S':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'i':
+                criteria.max_iterations = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'r':
+                repetitions = std::max(atoi(optarg), 1);
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'f':
+                format = optarg;
+                break;
+            case 'b':
+                bind = optarg;
+                break;
+            case 'R':
+                GetThreadPlacement().replicate = true;
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (!lists_valid) {
+        cerr << "Error: invalid list of numbers" << endl;
+        return 1;
+    }
+    if (format != "full" && format != "threads" && format != "report") {
+        cerr << "Error: unknown format " << format << endl;
+        return 1;
+    }
+    // Only full format has engine and dimensions columns
+    if (format != "full" && (engines.size() > 1 || dimensions_numbers.size() > 1)) {
+        cerr << "Error: format " << format << " takes one engine and one dimensions number,"
+             << " use --format=full" << endl;
+        return 1;
+    }
+    if (GetThreadPlacement().replicate && bind == "none") {
+        cerr << "Error: --replicate-centroids needs pinned threads, see --bind" << endl;
+        return 1;
+    }
+    if (!SelectNearestCentroidKernel("auto")) {
+        return 1;
+    }
+
+    if (format == "threads") {
+        cout << "THREADS_NUMBER, TIME" << endl;
+    } else if (format == "report") {
+        cout << "POINTS_NUMBER, CLUSTERS_NUMBER, THREADS_NUMBER, TIME" << endl;
+    } else {
+        cout << "POINTS_NUMBER, CLUSTERS_NUMBER, DIMENSIONS, THREADS_NUMBER, ENGINE, ITERATIONS, "
+             << "INIT_TIME, ASSIGN_TIME, UPDATE_TIME, IO_TIME, TIME" << endl;
+    }
+    cout << std::fixed << std::setprecision(6);
+
+    // Threads are the outer loop as in reports plotted by plotReport.R. Data
+    // sets are generated once, and for every threads number copied into new
+    // matrices first touched by the current pinned team, so on NUMA machines
+    // pages are placed as in a run with only that threads number
+    map<vector<size_t>, Points> data_sets;
+    for (size_t threads : threads_numbers) {
+        omp_set_num_threads(threads);
+        if (!PinThreads(bind)) {
+            return 1;
+        }
+        for (size_t points_number : points_numbers) {
+            for (size_t K : clusters_numbers) {
+                for (size_t dimensions : dimensions_numbers) {
+                    vector<size_t> key = {points_number, K, dimensions};
+                    if (data_sets.find(key) == data_sets.end()) {
+                        data_sets[key] = GeneratePoints(dimensions, points_number, K, seed);
+                    }
+                    Points data;
+                    data.AssignFrom(data_sets[key]);
+                    for (const string& engine : engines) {
+                        BenchmarkRun run;
+                        vector<double> init_times, assign_times, update_times, io_times, times;
+                        for (size_t repetition = 0; repetition < warmup + repetitions; ++repetition) {
+                            if (!RunOnce(data, K, engine, init, seed, criteria, output_file.c_str(), &run)) {
+                                return 1;
+                            }
+                            if (repetition >= warmup) {
+                                init_times.push_back(run.init_time);
+                                assign_times.push_back(run.assign_time);
+                                update_times.push_back(run.update_time);
+                                io_times.push_back(run.io_time);
+                                times.push_back(run.time);
+                            }
+                        }
+                        if (format == "threads") {
+                            cout << threads << ", " << Median(times) << endl;
+                        } else if (format == "report") {
+                            cout << points_number << ", " << K << ", " << threads << ", "
+                                 << Median(times) << endl;
+                        } else {
+                            cout << points_number << ", " << K << ", " << dimensions << ", " << threads
+                                 << ", " << engine << ", " << run.iterations << ", "
+                                 << Median(init_times) << ", " << Median(assign_times) << ", "
+                                 << Median(update_times) << ", " << Median(io_times) << ", "
+                                 << Median(times) << endl;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
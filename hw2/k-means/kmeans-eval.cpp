@@ -0,0 +1,310 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "kmeans.h"
+#include "points.h"
+
+using namespace std;
+
+/*
+    Quality of k-means labels. Centroids are recomputed as means of labelled
+    points, then reported are
+      - inertia: sum of squared distances to centroids of own clusters,
+      - silhouette: mean of (b - a) / max(a, b) over a random sample, where
+        a is mean distance to the other sampled points of own cluster and b
+        the smallest mean distance to sampled points of another cluster,
+      - Davies-Bouldin index: mean over clusters of the largest
+        (s_i + s_j) / |c_i - c_j|, s being mean distance to the centroid,
+      - adjusted Rand index against ground-truth labels when given.
+    Everything except silhouette is exact and linear in points number.
+*/
+
+// Means of labelled points, empty clusters have zero size
+void ClusterMeans(const Points& data, const vector<size_t>& labels, size_t K, Points* centroids,
+                  vector<size_t>* sizes) {
+    ClusterAccumulator<double> accumulator(K, data.Dimensions());
+    size_t data_size = data.Size();
+    #pragma omp parallel
+    {
+        size_t thread = omp_get_thread_num();
+        vector<double> buffer(data.Dimensions());
+        accumulator.Clear(thread);
+        #pragma omp for schedule(static) nowait
+        for (size_t i = 0; i < data_size; ++i) {
+            accumulator.Add(thread, K, labels[i], data.GetPoint(i, buffer.data()));
+        }
+        accumulator.Merge(centroids, sizes);
+    }
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t d = 0; d < data.Dimensions() && (*sizes)[k] != 0; ++d) {
+            (*centroids)(k, d) /= (*sizes)[k];
+        }
+    }
+}
+
+double DaviesBouldin(const Points& data, const vector<size_t>& labels, const Points& centroids,
+                     const vector<size_t>& sizes) {
+    size_t K = centroids.Size();
+    size_t dimensions = data.Dimensions();
+    size_t data_size = data.Size();
+    // Per-thread sums of distances added in thread order
+    size_t threads = omp_get_max_threads();
+    vector<vector<double> > partial_scatter(threads, vector<double>(K, 0));
+    #pragma omp parallel num_threads(threads)
+    {
+        vector<double>& local_scatter = partial_scatter[omp_get_thread_num()];
+        vector<double> buffer(dimensions);
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < data_size; ++i) {
+            const double* point = data.GetPoint(i, buffer.data());
+            local_scatter[labels[i]] += Distance(point, centroids.Row(labels[i]), dimensions);
+        }
+    }
+    vector<double> scatter(K, 0);
+    for (size_t thread = 0; thread < threads; ++thread) {
+        for (size_t k = 0; k < K; ++k) {
+            scatter[k] += partial_scatter[thread][k];
+        }
+    }
+
+    double sum = 0;
+    size_t clusters = 0;
+    for (size_t i = 0; i < K; ++i) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+        double worst = 0;
+        for (size_t j = 0; j < K; ++j) {
+            if (j == i || sizes[j] == 0) {
+                continue;
+            }
+            double separation = Distance(centroids.Row(i), centroids.Row(j), dimensions);
+            double ratio = (scatter[i] / sizes[i] + scatter[j] / sizes[j]) / separation;
+            worst = std::max(worst, separation > 0 ? ratio : numeric_limits<double>::infinity());
+        }
+        sum += worst;
+        ++clusters;
+    }
+    return clusters != 0 ? sum / clusters : 0;
+}
+
+// Silhouette over up to sample_size points picked uniformly without
+// replacement, quadratic in sample size
+double SampledSilhouette(const Points& data, const vector<size_t>& labels, size_t K,
+                         size_t sample_size, uint64_t seed) {
+    size_t data_size = data.Size();
+    size_t dimensions = data.Dimensions();
+    sample_size = std::min(sample_size, data_size);
+    // Partial Fisher-Yates shuffle of indices
+    vector<size_t> indices(data_size);
+    for (size_t i = 0; i < data_size; ++i) {
+        indices[i] = i;
+    }
+    for (size_t i = 0; i < sample_size; ++i) {
+        std::swap(indices[i], indices[i + HashRandom(seed, 0, i) % (data_size - i)]);
+    }
+    Points sample(sample_size, dimensions);
+    vector<size_t> sample_labels(sample_size);
+    vector<size_t> sample_sizes(K, 0);
+    for (size_t s = 0; s < sample_size; ++s) {
+        data.CopyPoint(indices[s], sample.Row(s));
+        sample_labels[s] = labels[indices[s]];
+        ++sample_sizes[sample_labels[s]];
+    }
+
+    double total = 0;
+    #pragma omp parallel reduction(+:total)
+    {
+        vector<double> distance_sums(K);
+        #pragma omp for schedule(static)
+        for (size_t s = 0; s < sample_size; ++s) {
+            std::fill(distance_sums.begin(), distance_sums.end(), 0.0);
+            for (size_t t = 0; t < sample_size; ++t) {
+                distance_sums[sample_labels[t]] += Distance(sample.Row(s), sample.Row(t), dimensions);
+            }
+            size_t own = sample_labels[s];
+            // Points alone in their cluster score 0 by convention
+            if (sample_sizes[own] < 2) {
+                continue;
+            }
+            double a = distance_sums[own] / (sample_sizes[own] - 1);
+            double b = numeric_limits<double>::infinity();
+            for (size_t k = 0; k < K; ++k) {
+                if (k != own && sample_sizes[k] != 0) {
+                    b = std::min(b, distance_sums[k] / sample_sizes[k]);
+                }
+            }
+            if (b != numeric_limits<double>::infinity() && std::max(a, b) > 0) {
+                total += (b - a) / std::max(a, b);
+            }
+        }
+    }
+    return sample_size != 0 ? total / sample_size : 0;
+}
+
+// Renumbers labels densely to 0, ..., K - 1 keeping their order and returns
+// K, so tables indexed by label stay bounded by the number of points
+size_t DenseLabels(vector<size_t>* labels) {
+    vector<size_t> distinct(*labels);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    size_t labels_size = labels->size();
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < labels_size; ++i) {
+        (*labels)[i] = std::lower_bound(distinct.begin(), distinct.end(), (*labels)[i]) - distinct.begin();
+    }
+    return distinct.size();
+}
+
+double PairsNumber(double n) {
+    return n * (n - 1) / 2;
+}
+
+// Adjusted Rand index from contingency table of two dense labellings with
+// K and truth_K labels, built from per-thread tables
+double AdjustedRandIndex(const vector<size_t>& labels, size_t K, const vector<size_t>& truth,
+                         size_t truth_K) {
+    size_t data_size = labels.size();
+    vector<size_t> table(K * truth_K, 0);
+    #pragma omp parallel
+    {
+        vector<size_t> local_table(K * truth_K, 0);
+        #pragma omp for schedule(static) nowait
+        for (size_t i = 0; i < data_size; ++i) {
+            ++local_table[labels[i] * truth_K + truth[i]];
+        }
+        #pragma omp critical
+        for (size_t cell = 0; cell < table.size(); ++cell) {
+            table[cell] += local_table[cell];
+        }
+    }
+
+    vector<size_t> rows(K, 0);
+    vector<size_t> columns(truth_K, 0);
+    double index = 0;
+    for (size_t k = 0; k < K; ++k) {
+        for (size_t j = 0; j < truth_K; ++j) {
+            size_t count = table[k * truth_K + j];
+            rows[k] += count;
+            columns[j] += count;
+            index += PairsNumber(count);
+        }
+    }
+    double rows_pairs = 0;
+    double columns_pairs = 0;
+    for (size_t k = 0; k < K; ++k) {
+        rows_pairs += PairsNumber(rows[k]);
+    }
+    for (size_t j = 0; j < truth_K; ++j) {
+        columns_pairs += PairsNumber(columns[j]);
+    }
+    // Single point has no pairs, labellings agree trivially
+    if (data_size < 2) {
+        return 1;
+    }
+    double expected = rows_pairs * columns_pairs / PairsNumber(data_size);
+    double maximum = (rows_pairs + columns_pairs) / 2;
+    // Identical trivial labellings agree perfectly
+    return maximum != expected ? (index - expected) / (maximum - expected) : 1;
+}
+
+void PrintUsage(const char* program) {
+    std::printf("Usage: %s [options] points_file labels_file\n", program);
+    std::printf("Options:\n");
+    std::printf("  --truth=FILE            ground-truth labels, e.g. from data-gen --labels,\n");
+    std::printf("                          for adjusted Rand index\n");
+    std::printf("  --silhouette-sample=N   points sampled for silhouette, 0 skips it\n");
+    std::printf("                          (default: 10000)\n");
+    std::printf("  --seed=N                random seed of the sample (default: 123)\n");
+}
+
+int main(int argc, char** argv) {
+    string truth_file;
+    size_t sample_size = 10000;
+    uint64_t seed = 123;
+
+    static const struct option long_options[] = {
+        {"truth", required_argument, nullptr, 't'},
+        {"silhouette-sample", required_argument, nullptr, 's'},
+        {"seed", required_argument, nullptr, 'S'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (option) {
+            case 't':
+                truth_file = optarg;
+                break;
+            case 's':
+                sample_size = strtoull(optarg, nullptr, 10);
+                break;
+            case 'S':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 2) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    const char* input_file = argv[optind];
+    const char* labels_file = argv[optind + 1];
+
+    PointsFile points_file;
+    Points data;
+    if (IsBinaryPointsFile(input_file)) {
+        if (!points_file.Open(input_file)) {
+            return 1;
+        }
+        data = points_file.Load<double>(ROW_MAJOR);
+    } else if (!ReadTextPoints(input_file, &data, ROW_MAJOR)) {
+        return 1;
+    }
+    vector<size_t> labels;
+    if (!ReadLabels(labels_file, &labels)) {
+        return 1;
+    }
+    if (labels.size() != data.Size() || labels.empty()) {
+        cerr << "Error: expected " << data.Size() << " labels, found " << labels.size() << endl;
+        return 1;
+    }
+    vector<size_t> truth;
+    if (!truth_file.empty()) {
+        if (!ReadLabels(truth_file.c_str(), &truth)) {
+            return 1;
+        }
+        if (truth.size() != data.Size()) {
+            cerr << "Error: expected " << data.Size() << " ground-truth labels, found "
+                 << truth.size() << endl;
+            return 1;
+        }
+    }
+
+    size_t K = DenseLabels(&labels);
+    size_t truth_K = truth.empty() ? 0 : DenseLabels(&truth);
+    Points centroids(K, data.Dimensions());
+    vector<size_t> sizes(K);
+    ClusterMeans(data, labels, K, &centroids, &sizes);
+
+    cout << "Points: " << data.Size() << endl;
+    cout << "Clusters: " << K - std::count(sizes.begin(), sizes.end(), size_t(0)) << endl;
+    cout << "Inertia: " << Inertia(data, labels, centroids) << endl;
+    if (sample_size != 0) {
+        cout << "Silhouette: " << SampledSilhouette(data, labels, K, sample_size, seed) << endl;
+    }
+    cout << "Davies-Bouldin: " << DaviesBouldin(data, labels, centroids, sizes) << endl;
+    if (!truth.empty()) {
+        cout << "Adjusted Rand index: " << AdjustedRandIndex(labels, K, truth, truth_K) << endl;
+    }
+    return 0;
+}
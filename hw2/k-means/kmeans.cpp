@@ -1,201 +1,223 @@
-#include <cmath>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <fstream>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string>
 #include <vector>
+#include <getopt.h>
 
-#include "omp.h"
+#include "kmeans.h"
+#include "points.h"
 
 using namespace std;
 
-typedef vector<double> Point;
-typedef vector<Point> Points;
-
-// Gives random number in range [0..max_value]
-unsigned int UniformRandom(unsigned int max_value) {
-    unsigned int rnd = ((static_cast<unsigned int>(rand()) % 32768) << 17) |
-                       ((static_cast<unsigned int>(rand()) % 32768) << 2) |
-                       rand() % 4;
-    return ((max_value + 1 == 0) ? rnd : rnd % (max_value + 1));
+// Writes centroids one per line in text points format without header
+void WriteCentroids(const Points& centroids, ofstream& output) {
+    output << std::setprecision(17);
+    for (size_t k = 0; k < centroids.Size(); ++k) {
+        for (size_t d = 0; d < centroids.Dimensions(); ++d) {
+            output << centroids(k, d) << (d + 1 == centroids.Dimensions() ? "\n" : " ");
+        }
+    }
 }
 
-double Distance(const Point& point1, const Point& point2) {
-    double distance_sqr = 0;
-    size_t dimensions = point1.size();
-    for (size_t i = 0; i < dimensions; ++i) {
-        distance_sqr += (point1[i] - point2[i]) * (point1[i] - point2[i]);
+int RunMiniBatch(const char* input_file, const char* output_file, size_t K, size_t batch_size,
+                 bool write_labels, const string& init, uint64_t seed,
+                 const StoppingCriteria& criteria) {
+    PointsStream stream;
+    if (!stream.Open(input_file)) {
+        return 1;
     }
-    return sqrt(distance_sqr);
-}
+    ofstream output(output_file);
+    if(!output) {
+        cerr << "Error: output file could not be opened" << endl;
+        return 1;
+    }
+
+    KMeansResult result;
+    if (!MiniBatchKMeans(&stream, K, batch_size, init, seed, criteria, &result)) {
+        return 1;
+    }
+    std::cerr << "Iterations: " << result.iterations << std::endl;
+    std::cerr << "Stopped by: " << StopReasonName(result.stop_reason) << std::endl;
 
-size_t FindNearestCentroid(const Points& centroids, const Point& point) {
-    double min_distance = Distance(point, centroids[0]);
-    size_t centroid_index = 0;
-    for (size_t i = 1; i < centroids.size(); ++i) {
-        double distance = Distance(point, centroids[i]);
-        if (distance < min_distance) {
-            min_distance = distance;
-            centroid_index = i;
+    if (write_labels) {
+        if (!AssignStream(&stream, result.centroids, batch_size, output, &result.inertia)) {
+            return 1;
         }
+        std::cerr << "Inertia: " << result.inertia << std::endl;
+    } else {
+        WriteCentroids(result.centroids, output);
     }
-    return centroid_index;
+    output.close();
+    return 0;
 }
 
-// Calculates new centroid position as mean of positions of 3 random centroids
-Point GetRandomPosition(const Points& centroids) {
-    size_t K = centroids.size();
-    int c1 = rand() % K;
-    int c2 = rand() % K;
-    int c3 = rand() % K;
-    size_t dimensions = centroids[0].size();
-    Point new_position(dimensions);
-    for (size_t d = 0; d < dimensions; ++d) {
-        new_position[d] = (centroids[c1][d] + centroids[c2][d] + centroids[c3][d]) / 3;
-    }
-    return new_position;
-}
+struct Options {
+    Options()
+        : layout(ROW_MAJOR), engine("auto"), init("random"), seed(123), update_period(1),
+          metrics_format("jsonl"), bind("none"), restarts(1), concurrent_restarts(1),
+          compare_double(false) {
+    }
 
-vector<size_t> KMeans(const Points& data, size_t K) {
-    size_t data_size = data.size();
-    size_t dimensions = data[0].size();
-    vector<size_t> clusters(data_size);
-
-    // Initialize centroids randomly at data points
-    Points centroids(K);
-    for (size_t i = 0; i < K; ++i) {
-        centroids[i] = data[UniformRandom(data_size - 1)];
-    }
-
-    size_t it = 0;
-    bool converged = false;
-    while (!converged) {
-        converged = true;
-        #pragma omp parallel for 
-        for (size_t i = 0; i < data_size; ++i) {
-            size_t nearest_cluster = FindNearestCentroid(centroids, data[i]);
-            if (clusters[i] != nearest_cluster) {
-                clusters[i] = nearest_cluster;
-                converged = false;
-            }
-        }
-        if (converged) {
-            break;
-        }
+    PointsLayout layout;
+    string engine;
+    string init;
+    uint64_t seed;
+    size_t update_period;
+    StoppingCriteria criteria;
+    string metrics_file;
+    string metrics_format;
+    string bind;
+    size_t restarts;
+    size_t concurrent_restarts;
+    bool compare_double;
+};
 
-        vector<size_t> clusters_sizes(K);
-        centroids.assign(K, Point(dimensions));
-        #pragma omp parallel for
-        for (size_t i = 0; i < data_size; ++i) {
-            for (size_t d = 0; d < dimensions; ++d) {
-                centroids[clusters[i]][d] += data[i][d];
-            }
-            ++clusters_sizes[clusters[i]];
-        }
-        for (size_t i = 0; i < K; ++i) {
-            if (clusters_sizes[i] != 0) {
-                for (size_t d = 0; d < dimensions; ++d) {
-                    centroids[i][d] /= clusters_sizes[i];
-                }
-            } else {
-                centroids[i] = GetRandomPosition(centroids);
-            }
+// Reads text or binary points file converting coordinates to T. Binary file
+// is kept mapped by points_file, so matching type is loaded without copying
+// unless first_touch asks for a copy placed by the threads which assign it.
+template <class T>
+bool LoadPoints(const char* input_file, PointsLayout layout, bool first_touch,
+                PointsFile* points_file, BasicPoints<T>* data) {
+    if (IsBinaryPointsFile(input_file)) {
+        if (!points_file->Open(input_file)) {
+            return false;
         }
-        ++it;
+        *data = points_file->Load<T>(layout, first_touch);
+        return true;
     }
-    std::cerr << "Iterations: " << it << std::endl;
-
-    return clusters;
+    return ReadTextPoints(input_file, data, layout);
 }
 
-vector<size_t> KMeansAlternative(const Points& data, size_t K) {
-    size_t data_size = data.size();
-    size_t dimensions = data[0].size();
-    vector<size_t> clusters(data_size);
-
-    // Initialize centroids randomly at data points
-    Points centroids(K);
-    for (size_t i = 0; i < K; ++i) {
-        centroids[i] = data[UniformRandom(data_size - 1)];
-    }
-
-    size_t iterationNumber = 0;
-
-    /*
-        To add determinism to algo we need to make constant number of iterations, otherwise,
-        running time will be affected greatly by random.
-    */
-    while (iterationNumber < 100) {
-        Points nextCentroids(K, Point(dimensions));
-        vector<size_t> clusters_sizes(K);
-
-        #pragma omp parallel for
-        for (size_t i = 0; i < data_size; ++i) {
-            size_t nearest_cluster = FindNearestCentroid(centroids, data[i]);
-            if (clusters[i] != nearest_cluster) {
-                clusters[i] = nearest_cluster;
-            }
-            for (size_t d = 0; d < dimensions; ++d) {
-                nextCentroids[nearest_cluster][d] += data[i][d];
-            }
-            ++clusters_sizes[nearest_cluster];
-        }
-
-        for (size_t i = 0; i < K; ++i) {
-            if (clusters_sizes[i] != 0) {
-                for (size_t d = 0; d < dimensions; ++d) {
-                    nextCentroids[i][d] /= clusters_sizes[i];
-                }
-            } else {
-                nextCentroids[i] = GetRandomPosition(centroids);
-            }
-        }
-        centroids = std::move(nextCentroids);
-        ++iterationNumber;
+// Opens per-iteration metrics log if requested, leaves log empty otherwise
+bool OpenMetricsLog(const Options& options, ofstream* output, std::unique_ptr<IterationLog>* log) {
+    if (options.metrics_file.empty()) {
+        return true;
     }
+    output->open(options.metrics_file.c_str());
+    if (!*output) {
+        cerr << "Error: metrics file could not be opened" << endl;
+        return false;
+    }
+    if (options.metrics_format == "chrome") {
+        log->reset(new ChromeTraceLog(*output));
+    } else {
+        log->reset(new JsonLinesLog(*output));
+    }
+    return true;
+}
 
-    return clusters;
+// Runs k-means assigning in T and accumulating centroids in A
+template <class T, class A>
+bool Cluster(const BasicPoints<T>& data, const Points& initial_centroids, const Options& options,
+             IterationLog* log, KMeansResult* result) {
+    std::unique_ptr<AssignmentStep<T, A> > step(CreateAssignmentStep<T, A>(
+        options.engine, data, initial_centroids.Size(), options.update_period));
+    if (!step) {
+        cerr << "Error: unknown engine " << options.engine << endl;
+        return false;
+    }
+    BasicPoints<A> centroids;
+    centroids.AssignFrom(initial_centroids);
+    *result = KMeans(data, std::move(centroids), step.get(), options.criteria, options.seed, log);
+    std::cerr << "Iterations: " << result->iterations << std::endl;
+    std::cerr << "Stopped by: " << StopReasonName(result->stop_reason) << std::endl;
+    std::cerr << "Inertia: " << result->inertia << std::endl;
+    step->Report();
+    return true;
 }
 
-void ReadPoints(Points* data, ifstream& input) {
-    size_t data_size;
-    size_t dimensions;
-    input >> data_size >> dimensions;
-    data->assign(data_size, Point(dimensions));
-    for (size_t i = 0; i < data_size; ++i) {
-        for (size_t d = 0; d < dimensions; ++d) {
-            double coord;
-            input >> coord;
-            (*data)[i][d] = coord;
+/*
+    Runs options.restarts independent seedings of the shared points and keeps
+    the lowest inertia result. Restart r is seeded like a run with seed + r.
+    Seeding is serial because random seeding draws from rand(), then
+    concurrent_restarts runs go at once, each in a nested parallel region
+    with its share of threads. Empty clusters are relocated from counter-based
+    streams of seed + r, so results don't depend on how runs interleave.
+*/
+template <class T, class A>
+bool ClusterRestarts(const BasicPoints<T>& data, size_t K, const Options& options,
+                     KMeansResult* best) {
+    size_t restarts = options.restarts;
+    vector<Points> initial_centroids(restarts);
+    for (size_t r = 0; r < restarts; ++r) {
+        srand(options.seed + r);
+        BasicPoints<T> centroids;
+        if (!SeedCentroids(data, K, options.init, options.seed + r, &centroids)) {
+            return false;
         }
+        initial_centroids[r].AssignFrom(centroids);
     }
-}
 
-void WriteOutput(const vector<size_t>& clusters, ofstream& output) {
-    for (size_t i = 0; i < clusters.size(); ++i) {
-        output << clusters[i] << endl;
+    size_t concurrent = std::min(options.concurrent_restarts, restarts);
+    size_t threads = std::max<size_t>(omp_get_max_threads() / concurrent, 1);
+    if (concurrent > 1) {
+        omp_set_max_active_levels(2);
+    }
+    vector<KMeansResult> results(restarts);
+    bool ok = true;
+    #pragma omp parallel for num_threads(concurrent) schedule(dynamic, 1)
+    for (size_t r = 0; r < restarts; ++r) {
+        omp_set_num_threads(threads);
+        std::unique_ptr<AssignmentStep<T, A> > step(CreateAssignmentStep<T, A>(
+            options.engine, data, K, options.update_period));
+        if (!step) {
+            #pragma omp atomic write
+            ok = false;
+            continue;
+        }
+        BasicPoints<A> centroids;
+        centroids.AssignFrom(initial_centroids[r]);
+        results[r] = KMeans(data, std::move(centroids), step.get(), options.criteria,
+                            options.seed + r);
+    }
+    if (!ok) {
+        cerr << "Error: unknown engine " << options.engine << endl;
+        return false;
     }
-}
 
-int main(int argc , char** argv) {
-    if (argc != 4) {
-        std::printf("Usage: %s number_of_clusters input_file output_file\n", argv[0]);
-        return 1;
+    size_t best_restart = 0;
+    for (size_t r = 0; r < restarts; ++r) {
+        std::cerr << "Restart " << r << ": iterations " << results[r].iterations
+                  << ", inertia " << results[r].inertia << std::endl;
+        if (results[r].inertia < results[best_restart].inertia) {
+            best_restart = r;
+        }
     }
-    size_t K = atoi(argv[1]);
+    *best = std::move(results[best_restart]);
+    std::cerr << "Best restart: " << best_restart << std::endl;
+    std::cerr << "Iterations: " << best->iterations << std::endl;
+    std::cerr << "Stopped by: " << StopReasonName(best->stop_reason) << std::endl;
+    std::cerr << "Inertia: " << best->inertia << std::endl;
+    return true;
+}
 
-    char* input_file = argv[2];
-    ifstream input;
-    input.open(input_file, ifstream::in);
-    if(!input) {
-        cerr << "Error: input file could not be opened" << endl;
+/*
+    Clusters points stored as T with centroids accumulated in A. With
+    compare_double points are read and seeded in double, converted to T, and
+    the same run is repeated in double afterwards to measure how many labels
+    the reduced precision changed. Both runs restart rand() from the seed, so
+    each matches a standalone run.
+*/
+template <class T, class A>
+int RunKMeans(const char* input_file, const char* output_file, size_t K, const Options& options) {
+    PointsFile points_file;
+    Points double_data;
+    BasicPoints<T> converted;
+    const BasicPoints<T>* data = &converted;
+    bool first_touch = options.bind != "none";
+    if (options.compare_double) {
+        if (!LoadPoints(input_file, options.layout, first_touch, &points_file, &double_data)) {
+            return 1;
+        }
+        converted.AssignFrom(double_data);
+    } else if (!LoadPoints(input_file, options.layout, first_touch, &points_file, &converted)) {
         return 1;
     }
 
-    Points data;
-    ReadPoints(&data, input);
-    input.close();
-
-    char* output_file = argv[3];
     ofstream output;
     output.open(output_file, ifstream::out);
     if(!output) {
@@ -203,13 +225,267 @@ int main(int argc , char** argv) {
         return 1;
     }
 
-    srand(123); // for reproducible results
+    if (options.restarts > 1) {
+        KMeansResult best;
+        if (!ClusterRestarts<T, A>(*data, K, options, &best)) {
+            return 1;
+        }
+        WriteLabels(best.clusters, output);
+        output.close();
+        return 0;
+    }
 
-    //vector<size_t> clusters = KMeans(data, K);
-    vector<size_t> clusters = KMeansAlternative(data, K);
+    Points initial_centroids;
+    bool seeded;
+    if (options.compare_double) {
+        seeded = SeedCentroids(double_data, K, options.init, options.seed, &initial_centroids);
+    } else {
+        BasicPoints<T> centroids;
+        seeded = SeedCentroids(*data, K, options.init, options.seed, &centroids);
+        initial_centroids.AssignFrom(centroids);
+    }
+    if (!seeded) {
+        return 1;
+    }
+    ofstream metrics_output;
+    std::unique_ptr<IterationLog> log;
+    if (!OpenMetricsLog(options, &metrics_output, &log)) {
+        return 1;
+    }
+    KMeansResult result;
+    if (!Cluster<T, A>(*data, initial_centroids, options, log.get(), &result)) {
+        return 1;
+    }
+    log.reset();
 
-    WriteOutput(clusters, output);
-    output.close();
+    if (options.compare_double) {
+        std::cerr << "Double precision reference:" << std::endl;
+        srand(options.seed);
+        SeedCentroids(double_data, K, options.init, options.seed, &initial_centroids);
+        KMeansResult reference;
+        Cluster<double, double>(double_data, initial_centroids, options, nullptr, &reference);
+        size_t agreed = 0;
+        for (size_t i = 0; i < result.clusters.size(); ++i) {
+            agreed += result.clusters[i] == reference.clusters[i];
+        }
+        std::cerr << "Labels agreement: " << static_cast<double>(agreed) / result.clusters.size()
+                  << " (" << agreed << " of " << result.clusters.size() << ")" << std::endl;
+        std::cerr << "Inertia relative difference: "
+                  << (result.inertia - reference.inertia) / reference.inertia << std::endl;
+    }
 
+    WriteLabels(result.clusters, output);
+    output.close();
     return 0;
 }
+
+void PrintUsage(const char* program) {
+    std::printf("Usage: %s [options] number_of_clusters input_file output_file\n", program);
+    std::printf("Input file is either text or binary points file, see points.h\n");
+    std::printf("Options:\n");
+    std::printf("  --layout=rows|columns   in-memory layout of points (default: rows)\n");
+    std::printf("  --engine=auto|lloyd|hamerly|kdtree|gemm\n");
+    std::printf("                          clustering algorithm, auto picks kdtree when\n");
+    std::printf("                          D <= 12 and K >= 256 * D, gemm when D >= 32 and\n");
+    std::printf("                          lloyd otherwise (default: auto)\n");
+    std::printf("  --kernel=auto|scalar|avx2|avx512\n");
+    std::printf("                          nearest centroid kernel (default: auto)\n");
+    std::printf("  --init=random|kmeans++|kmeans||\n");
+    std::printf("                          centroids seeding method (default: random)\n");
+    std::printf("  --seed=N                random seed (default: 123)\n");
+    std::printf("  --precision=double|float|mixed\n");
+    std::printf("                          float assigns and accumulates in float, mixed\n");
+    std::printf("                          assigns in float and accumulates centroids in\n");
+    std::printf("                          double (default: double)\n");
+    std::printf("  --full-update-every=N   with N > 1 update cluster sums only from points\n");
+    std::printf("                          which changed cluster and recompute them from all\n");
+    std::printf("                          points every N iterations (default: 1)\n");
+    std::printf("  --metrics=FILE          write per-iteration timings, reassigned points,\n");
+    std::printf("                          inertia, largest shift, empty clusters and\n");
+    std::printf("                          per-thread assignment times\n");
+    std::printf("  --metrics-format=jsonl|chrome\n");
+    std::printf("                          JSON object per line or Chrome trace\n");
+    std::printf("                          (default: jsonl)\n");
+    std::printf("  --bind=none|compact|scatter\n");
+    std::printf("                          pin threads to CPUs filling socket after socket\n");
+    std::printf("                          or round robin over sockets; binary input is\n");
+    std::printf("                          then copied to memory local to the threads\n");
+    std::printf("                          instead of used in place (default: none, as set\n");
+    std::printf("                          by OMP_PROC_BIND)\n");
+    std::printf("  --replicate-centroids   with --bind, keep a copy of centroids on every\n");
+    std::printf("                          socket for lloyd, hamerly and gemm engines\n");
+    std::printf("  --restarts=R            run R seedings, restart r with seed + r, and\n");
+    std::printf("                          keep labels of the lowest inertia (default: 1)\n");
+    std::printf("  --concurrent-restarts=C run C restarts at once, each with 1/C of threads\n");
+    std::printf("                          (default: 1, one after another with all threads)\n");
+    std::printf("  --compare-double        also run in double from the same centroids and\n");
+    std::printf("                          report labels agreement\n");
+    std::printf("  --mini-batch=B          stream input in batches of B points and run\n");
+    std::printf("                          mini-batch k-means with bounded memory\n");
+    std::printf("  --centroids-only        with --mini-batch, skip final assignment pass\n");
+    std::printf("                          and write centroids instead of labels\n");
+    std::printf("Stopping criteria, negative value disables criterion:\n");
+    std::printf("  --max-iterations=N      iterations limit (default: 100)\n");
+    std::printf("  --tolerance=X           largest centroid shift (default: 0)\n");
+    std::printf("  --reassigned=X          fraction of reassigned points (default: 0)\n");
+    std::printf("  --inertia-tolerance=X   relative inertia change (default: -1)\n");
+}
+
+int main(int argc , char** argv) {
+    Options options;
+    string kernel = "auto";
+    string precision = "double";
+    size_t batch_size = 0;
+    bool write_labels = true;
+
+    static const struct option long_options[] = {
+        {"layout", required_argument, nullptr, 'l'},
+        {"engine", required_argument, nullptr, 'e'},
+        {"kernel", required_argument, nullptr, 'k'},
+        {"max-iterations", required_argument, nullptr, 'i'},
+        {"tolerance", required_argument, nullptr, 't'},
+        {"reassigned", required_argument, nullptr, 'r'},
+        {"inertia-tolerance", required_argument, nullptr, 'n'},
+        {"init", required_argument, nullptr, 's'},
+        {"seed", required_argument, nullptr, 'S'},
+        {"mini-batch", required_argument, nullptr, 'b'},
+        {"centroids-only", no_argument, nullptr, 'c'},
+        {"precision", required_argument, nullptr, 'p'},
+        {"compare-double", no_argument, nullptr, 'C'},
+        {"full-update-every", required_argument, nullptr, 'u'},
+        {"metrics", required_argument, nullptr, 'm'},
+        {"metrics-format", required_argument, nullptr, 'M'},
+        {"bind", required_argument, nullptr, 'B'},
+        {"replicate-centroids", no_argument, nullptr, 'R'},
+        {"restarts", required_argument, nullptr, 'x'},
+        {"concurrent-restarts", required_argument, nullptr, 'X'},
+        {nullptr, 0, nullptr, 0}
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (option) {
+            case 'l':
+                if (string(optarg) == "rows") {
+                    options.layout = ROW_MAJOR;
+                } else if (string(optarg) == "columns") {
+                    options.layout = COLUMN_MAJOR;
+                } else {
+                    cerr << "Error: unknown layout " << optarg << endl;
+                    return 1;
+                }
+                break;
+            case 'e':
+                options.engine = optarg;
+                break;
+            case 'k':
+                kernel = optarg;
+                break;
+            case 'i':
+                options.criteria.max_iterations = atoi(optarg);
+                break;
+            case 't':
+                options.criteria.max_shift = atof(optarg);
+                break;
+            case 'r':
+                options.criteria.reassigned_fraction = atof(optarg);
+                break;
+            case 'n':
+                options.criteria.inertia_change = atof(optarg);
+                break;
+            case 's':
+                options.init = optarg;
+                break;
+            case 'S':
+                options.seed = strtoull(optarg, nullptr, 10);
+                break;
+            case 'b':
+                batch_size = atoi(optarg);
+                break;
+            case 'c':
+                write_labels = false;
+                break;
+            case 'p':
+                precision = optarg;
+                break;
+            case 'C':
+                options.compare_double = true;
+                break;
+            case 'u':
+                options.update_period = atoi(optarg);
+                break;
+            case 'm':
+                options.metrics_file = optarg;
+                break;
+            case 'M':
+                options.metrics_format = optarg;
+                if (options.metrics_format != "jsonl" && options.metrics_format != "chrome") {
+                    cerr << "Error: unknown metrics format " << optarg << endl;
+                    return 1;
+                }
+                break;
+            case 'B':
+                options.bind = optarg;
+                break;
+            case 'R':
+                GetThreadPlacement().replicate = true;
+                break;
+            case 'x':
+                options.restarts = std::max(atoi(optarg), 1);
+                break;
+            case 'X':
+                options.concurrent_restarts = std::max(atoi(optarg), 1);
+                break;
+            default:
+                PrintUsage(argv[0]);
+                return 1;
+        }
+    }
+    if (argc - optind != 3) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+    if (!SelectNearestCentroidKernel(kernel)) {
+        cerr << "Error: kernel " << kernel << " is not supported" << endl;
+        return 1;
+    }
+    if (GetThreadPlacement().replicate && options.bind == "none") {
+        cerr << "Error: --replicate-centroids needs pinned threads, see --bind" << endl;
+        return 1;
+    }
+    // Replicas are indexed by thread number, which is ambiguous in nested teams
+    if (GetThreadPlacement().replicate && options.restarts > 1 && options.concurrent_restarts > 1) {
+        cerr << "Error: --replicate-centroids does not combine with --concurrent-restarts" << endl;
+        return 1;
+    }
+    if (options.restarts > 1 &&
+        (options.compare_double || !options.metrics_file.empty() || batch_size != 0)) {
+        cerr << "Error: --restarts does not combine with --compare-double, --metrics"
+             << " and --mini-batch" << endl;
+        return 1;
+    }
+    if (!PinThreads(options.bind)) {
+        return 1;
+    }
+    argv += optind;
+    size_t K = atoi(argv[0]);
+    srand(options.seed); // for reproducible results
+
+    if (batch_size != 0) {
+        if (precision != "double") {
+            cerr << "Error: mini-batch mode supports only double precision" << endl;
+            return 1;
+        }
+        return RunMiniBatch(argv[1], argv[2], K, batch_size, write_labels, options.init,
+                            options.seed, options.criteria);
+    }
+
+    if (precision == "double") {
+        return RunKMeans<double, double>(argv[1], argv[2], K, options);
+    } else if (precision == "float") {
+        return RunKMeans<float, float>(argv[1], argv[2], K, options);
+    } else if (precision == "mixed") {
+        return RunKMeans<float, double>(argv[1], argv[2], K, options);
+    }
+    cerr << "Error: unknown precision " << precision << endl;
+    return 1;
+}
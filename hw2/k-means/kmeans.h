@@ -0,0 +1,1832 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <immintrin.h>
+
+#include "affinity.h"
+#include "omp.h"
+#include "points.h"
+#include "random.h"
+
+/*
+    k-means engines shared by kmeans tools. Engines are templated on scalar
+    type T of points used for assignment and type A in which cluster sums and
+    centroids are accumulated: <double, double> is the reference path,
+    <float, float> halves memory traffic, <float, double> assigns in float
+    but keeps centroids in double.
+*/
+
+// Gives random number in range [0..max_value]
+inline unsigned int UniformRandom(unsigned int max_value) {
+    unsigned int rnd = ((static_cast<unsigned int>(rand()) % 32768) << 17) |
+                       ((static_cast<unsigned int>(rand()) % 32768) << 2) |
+                       rand() % 4;
+    return ((max_value + 1 == 0) ? rnd : rnd % (max_value + 1));
+}
+
+template <class T>
+T SquaredDistance(const T* point1, const T* point2, size_t dimensions) {
+    T distance_sqr = 0;
+    for (size_t i = 0; i < dimensions; ++i) {
+        distance_sqr += (point1[i] - point2[i]) * (point1[i] - point2[i]);
+    }
+    return distance_sqr;
+}
+
+template <class T>
+T Distance(const T* point1, const T* point2, size_t dimensions) {
+    return std::sqrt(SquaredDistance(point1, point2, dimensions));
+}
+
+// Centroids transposed for the assignment kernels: coordinate d of centroid k
+// is stored at d * Stride() + k, so one vector load brings the same coordinate
+// of several centroids. Stride is padded to a full AVX-512 register, padding
+// centroids are placed at infinity and never win.
+template <class T>
+class CentroidsTable {
+public:
+    static const size_t kLanes = 64 / sizeof(T);
+
+    template <class A>
+    void Load(const BasicPoints<A>& centroids) {
+        size_ = centroids.Size();
+        dimensions_ = centroids.Dimensions();
+        stride_ = (size_ + kLanes - 1) / kLanes * kLanes;
+        coords_.Assign(dimensions_, stride_);
+        coords_.Fill(std::numeric_limits<T>::infinity());
+        for (size_t k = 0; k < size_; ++k) {
+            for (size_t d = 0; d < dimensions_; ++d) {
+                coords_(d, k) = static_cast<T>(centroids(k, d));
+            }
+        }
+    }
+
+    size_t Size() const { return size_; }
+    size_t Dimensions() const { return dimensions_; }
+    size_t Stride() const { return stride_; }
+
+    // Coordinate d of all centroids, aligned and Stride() long
+    const T* Coords(size_t d) const {
+        return coords_.Row(d);
+    }
+
+private:
+    size_t size_;
+    size_t dimensions_;
+    size_t stride_;
+    BasicPoints<T> coords_;
+};
+
+template <class T>
+size_t NearestCentroidScalar(const CentroidsTable<T>& centroids, const T* point,
+                             T* min_distance_sqr) {
+    size_t dimensions = centroids.Dimensions();
+    T min_distance = std::numeric_limits<T>::infinity();
+    size_t centroid_index = 0;
+    for (size_t k = 0; k < centroids.Size(); ++k) {
+        T distance = 0;
+        for (size_t d = 0; d < dimensions; ++d) {
+            T diff = centroids.Coords(d)[k] - point[d];
+            distance += diff * diff;
+        }
+        if (distance < min_distance) {
+            min_distance = distance;
+            centroid_index = k;
+        }
+    }
+    *min_distance_sqr = min_distance;
+    return centroid_index;
+}
+
+// Picks the lowest index among lanes holding the minimal distance, which
+// matches the first-minimum semantics of the scalar kernel. Indices are kept
+// in lanes of the same type as distances.
+template <class T>
+size_t ReduceLanes(const T* distances, const T* indices, size_t lanes, T* min_distance_sqr) {
+    size_t best = 0;
+    for (size_t lane = 1; lane < lanes; ++lane) {
+        if (distances[lane] < distances[best] ||
+            (distances[lane] == distances[best] && indices[lane] < indices[best])) {
+            best = lane;
+        }
+    }
+    *min_distance_sqr = distances[best];
+    return static_cast<size_t>(indices[best]);
+}
+
+__attribute__((target("avx2,fma")))
+inline size_t NearestCentroidAvx2(const CentroidsTable<double>& centroids, const double* point,
+                                  double* min_distance_sqr) {
+    size_t dimensions = centroids.Dimensions();
+    __m256d best_distance = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    __m256d best_index = _mm256_setzero_pd();
+    __m256d index = _mm256_set_pd(3, 2, 1, 0);
+    const __m256d step = _mm256_set1_pd(4);
+    for (size_t k = 0; k < centroids.Stride(); k += 4) {
+        __m256d distance = _mm256_setzero_pd();
+        for (size_t d = 0; d < dimensions; ++d) {
+            __m256d diff = _mm256_sub_pd(_mm256_load_pd(centroids.Coords(d) + k),
+                                         _mm256_broadcast_sd(point + d));
+            distance = _mm256_fmadd_pd(diff, diff, distance);
+        }
+        __m256d closer = _mm256_cmp_pd(distance, best_distance, _CMP_LT_OQ);
+        best_distance = _mm256_blendv_pd(best_distance, distance, closer);
+        best_index = _mm256_blendv_pd(best_index, index, closer);
+        index = _mm256_add_pd(index, step);
+    }
+    alignas(32) double distances[4];
+    alignas(32) double indices[4];
+    _mm256_store_pd(distances, best_distance);
+    _mm256_store_pd(indices, best_index);
+    return ReduceLanes(distances, indices, 4, min_distance_sqr);
+}
+
+__attribute__((target("avx2,fma")))
+inline size_t NearestCentroidAvx2(const CentroidsTable<float>& centroids, const float* point,
+                                  float* min_distance_sqr) {
+    size_t dimensions = centroids.Dimensions();
+    __m256 best_distance = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+    __m256 best_index = _mm256_setzero_ps();
+    __m256 index = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m256 step = _mm256_set1_ps(8);
+    for (size_t k = 0; k < centroids.Stride(); k += 8) {
+        __m256 distance = _mm256_setzero_ps();
+        for (size_t d = 0; d < dimensions; ++d) {
+            __m256 diff = _mm256_sub_ps(_mm256_load_ps(centroids.Coords(d) + k),
+                                        _mm256_broadcast_ss(point + d));
+            distance = _mm256_fmadd_ps(diff, diff, distance);
+        }
+        __m256 closer = _mm256_cmp_ps(distance, best_distance, _CMP_LT_OQ);
+        best_distance = _mm256_blendv_ps(best_distance, distance, closer);
+        best_index = _mm256_blendv_ps(best_index, index, closer);
+        index = _mm256_add_ps(index, step);
+    }
+    alignas(32) float distances[8];
+    alignas(32) float indices[8];
+    _mm256_store_ps(distances, best_distance);
+    _mm256_store_ps(indices, best_index);
+    return ReduceLanes(distances, indices, 8, min_distance_sqr);
+}
+
+__attribute__((target("avx512f")))
+inline size_t NearestCentroidAvx512(const CentroidsTable<double>& centroids, const double* point,
+                                    double* min_distance_sqr) {
+    size_t dimensions = centroids.Dimensions();
+    __m512d best_distance = _mm512_set1_pd(std::numeric_limits<double>::infinity());
+    __m512d best_index = _mm512_setzero_pd();
+    __m512d index = _mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512d step = _mm512_set1_pd(8);
+    for (size_t k = 0; k < centroids.Stride(); k += 8) {
+        __m512d distance = _mm512_setzero_pd();
+        for (size_t d = 0; d < dimensions; ++d) {
+            __m512d diff = _mm512_sub_pd(_mm512_load_pd(centroids.Coords(d) + k),
+                                         _mm512_set1_pd(point[d]));
+            distance = _mm512_fmadd_pd(diff, diff, distance);
+        }
+        __mmask8 closer = _mm512_cmp_pd_mask(distance, best_distance, _CMP_LT_OQ);
+        best_distance = _mm512_mask_blend_pd(closer, best_distance, distance);
+        best_index = _mm512_mask_blend_pd(closer, best_index, index);
+        index = _mm512_add_pd(index, step);
+    }
+    alignas(64) double distances[8];
+    alignas(64) double indices[8];
+    _mm512_store_pd(distances, best_distance);
+    _mm512_store_pd(indices, best_index);
+    return ReduceLanes(distances, indices, 8, min_distance_sqr);
+}
+
+__attribute__((target("avx512f")))
+inline size_t NearestCentroidAvx512(const CentroidsTable<float>& centroids, const float* point,
+                                    float* min_distance_sqr) {
+    size_t dimensions = centroids.Dimensions();
+    __m512 best_distance = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+    __m512 best_index = _mm512_setzero_ps();
+    __m512 index = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const __m512 step = _mm512_set1_ps(16);
+    for (size_t k = 0; k < centroids.Stride(); k += 16) {
+        __m512 distance = _mm512_setzero_ps();
+        for (size_t d = 0; d < dimensions; ++d) {
+            __m512 diff = _mm512_sub_ps(_mm512_load_ps(centroids.Coords(d) + k),
+                                        _mm512_set1_ps(point[d]));
+            distance = _mm512_fmadd_ps(diff, diff, distance);
+        }
+        __mmask16 closer = _mm512_cmp_ps_mask(distance, best_distance, _CMP_LT_OQ);
+        best_distance = _mm512_mask_blend_ps(closer, best_distance, distance);
+        best_index = _mm512_mask_blend_ps(closer, best_index, index);
+        index = _mm512_add_ps(index, step);
+    }
+    alignas(64) float distances[16];
+    alignas(64) float indices[16];
+    _mm512_store_ps(distances, best_distance);
+    _mm512_store_ps(indices, best_index);
+    return ReduceLanes(distances, indices, 16, min_distance_sqr);
+}
+
+// Register block of GEMM assignment: dot products of kGemmRows points with
+// kGemmColumns centroids are kept in registers over the whole depth
+const size_t kGemmRows = 4;
+const size_t kGemmColumns = 16;
+
+// dots[r * kGemmColumns + j] = points row r . centroid j, where points are
+// kGemmRows packed rows of given depth and centroids_t holds coordinate d of
+// kGemmColumns centroids at d * stride, aligned to cache line
+template <class T>
+void DotBlockScalar(const T* points, size_t depth, const T* centroids_t, size_t stride, T* dots) {
+    std::fill(dots, dots + kGemmRows * kGemmColumns, T(0));
+    for (size_t d = 0; d < depth; ++d) {
+        const T* column = centroids_t + d * stride;
+        for (size_t r = 0; r < kGemmRows; ++r) {
+            T x = points[r * depth + d];
+            for (size_t j = 0; j < kGemmColumns; ++j) {
+                dots[r * kGemmColumns + j] += x * column[j];
+            }
+        }
+    }
+}
+
+// Eight columns of four rows in 8 accumulators, called twice to cover block
+__attribute__((target("avx2,fma")))
+inline void DotHalfBlockAvx2(const double* points, size_t depth, const double* centroids_t,
+                             size_t stride, double* dots) {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+    for (size_t d = 0; d < depth; ++d) {
+        __m256d b0 = _mm256_load_pd(centroids_t + d * stride);
+        __m256d b1 = _mm256_load_pd(centroids_t + d * stride + 4);
+        __m256d a = _mm256_broadcast_sd(points + d);
+        c00 = _mm256_fmadd_pd(a, b0, c00);
+        c01 = _mm256_fmadd_pd(a, b1, c01);
+        a = _mm256_broadcast_sd(points + depth + d);
+        c10 = _mm256_fmadd_pd(a, b0, c10);
+        c11 = _mm256_fmadd_pd(a, b1, c11);
+        a = _mm256_broadcast_sd(points + 2 * depth + d);
+        c20 = _mm256_fmadd_pd(a, b0, c20);
+        c21 = _mm256_fmadd_pd(a, b1, c21);
+        a = _mm256_broadcast_sd(points + 3 * depth + d);
+        c30 = _mm256_fmadd_pd(a, b0, c30);
+        c31 = _mm256_fmadd_pd(a, b1, c31);
+    }
+    _mm256_storeu_pd(dots, c00);
+    _mm256_storeu_pd(dots + 4, c01);
+    _mm256_storeu_pd(dots + kGemmColumns, c10);
+    _mm256_storeu_pd(dots + kGemmColumns + 4, c11);
+    _mm256_storeu_pd(dots + 2 * kGemmColumns, c20);
+    _mm256_storeu_pd(dots + 2 * kGemmColumns + 4, c21);
+    _mm256_storeu_pd(dots + 3 * kGemmColumns, c30);
+    _mm256_storeu_pd(dots + 3 * kGemmColumns + 4, c31);
+}
+
+__attribute__((target("avx2,fma")))
+inline void DotBlockAvx2(const double* points, size_t depth, const double* centroids_t,
+                         size_t stride, double* dots) {
+    DotHalfBlockAvx2(points, depth, centroids_t, stride, dots);
+    DotHalfBlockAvx2(points, depth, centroids_t + 8, stride, dots + 8);
+}
+
+__attribute__((target("avx2,fma")))
+inline void DotBlockAvx2(const float* points, size_t depth, const float* centroids_t,
+                         size_t stride, float* dots) {
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    for (size_t d = 0; d < depth; ++d) {
+        __m256 b0 = _mm256_load_ps(centroids_t + d * stride);
+        __m256 b1 = _mm256_load_ps(centroids_t + d * stride + 8);
+        __m256 a = _mm256_broadcast_ss(points + d);
+        c00 = _mm256_fmadd_ps(a, b0, c00);
+        c01 = _mm256_fmadd_ps(a, b1, c01);
+        a = _mm256_broadcast_ss(points + depth + d);
+        c10 = _mm256_fmadd_ps(a, b0, c10);
+        c11 = _mm256_fmadd_ps(a, b1, c11);
+        a = _mm256_broadcast_ss(points + 2 * depth + d);
+        c20 = _mm256_fmadd_ps(a, b0, c20);
+        c21 = _mm256_fmadd_ps(a, b1, c21);
+        a = _mm256_broadcast_ss(points + 3 * depth + d);
+        c30 = _mm256_fmadd_ps(a, b0, c30);
+        c31 = _mm256_fmadd_ps(a, b1, c31);
+    }
+    _mm256_storeu_ps(dots, c00);
+    _mm256_storeu_ps(dots + 8, c01);
+    _mm256_storeu_ps(dots + kGemmColumns, c10);
+    _mm256_storeu_ps(dots + kGemmColumns + 8, c11);
+    _mm256_storeu_ps(dots + 2 * kGemmColumns, c20);
+    _mm256_storeu_ps(dots + 2 * kGemmColumns + 8, c21);
+    _mm256_storeu_ps(dots + 3 * kGemmColumns, c30);
+    _mm256_storeu_ps(dots + 3 * kGemmColumns + 8, c31);
+}
+
+__attribute__((target("avx512f")))
+inline void DotBlockAvx512(const double* points, size_t depth, const double* centroids_t,
+                           size_t stride, double* dots) {
+    __m512d c00 = _mm512_setzero_pd(), c01 = _mm512_setzero_pd();
+    __m512d c10 = _mm512_setzero_pd(), c11 = _mm512_setzero_pd();
+    __m512d c20 = _mm512_setzero_pd(), c21 = _mm512_setzero_pd();
+    __m512d c30 = _mm512_setzero_pd(), c31 = _mm512_setzero_pd();
+    for (size_t d = 0; d < depth; ++d) {
+        __m512d b0 = _mm512_load_pd(centroids_t + d * stride);
+        __m512d b1 = _mm512_load_pd(centroids_t + d * stride + 8);
+        __m512d a = _mm512_set1_pd(points[d]);
+        c00 = _mm512_fmadd_pd(a, b0, c00);
+        c01 = _mm512_fmadd_pd(a, b1, c01);
+        a = _mm512_set1_pd(points[depth + d]);
+        c10 = _mm512_fmadd_pd(a, b0, c10);
+        c11 = _mm512_fmadd_pd(a, b1, c11);
+        a = _mm512_set1_pd(points[2 * depth + d]);
+        c20 = _mm512_fmadd_pd(a, b0, c20);
+        c21 = _mm512_fmadd_pd(a, b1, c21);
+        a = _mm512_set1_pd(points[3 * depth + d]);
+        c30 = _mm512_fmadd_pd(a, b0, c30);
+        c31 = _mm512_fmadd_pd(a, b1, c31);
+    }
+    _mm512_storeu_pd(dots, c00);
+    _mm512_storeu_pd(dots + 8, c01);
+    _mm512_storeu_pd(dots + kGemmColumns, c10);
+    _mm512_storeu_pd(dots + kGemmColumns + 8, c11);
+    _mm512_storeu_pd(dots + 2 * kGemmColumns, c20);
+    _mm512_storeu_pd(dots + 2 * kGemmColumns + 8, c21);
+    _mm512_storeu_pd(dots + 3 * kGemmColumns, c30);
+    _mm512_storeu_pd(dots + 3 * kGemmColumns + 8, c31);
+}
+
+__attribute__((target("avx512f")))
+inline void DotBlockAvx512(const float* points, size_t depth, const float* centroids_t,
+                           size_t stride, float* dots) {
+    __m512 c0 = _mm512_setzero_ps();
+    __m512 c1 = _mm512_setzero_ps();
+    __m512 c2 = _mm512_setzero_ps();
+    __m512 c3 = _mm512_setzero_ps();
+    for (size_t d = 0; d < depth; ++d) {
+        __m512 b = _mm512_load_ps(centroids_t + d * stride);
+        c0 = _mm512_fmadd_ps(_mm512_set1_ps(points[d]), b, c0);
+        c1 = _mm512_fmadd_ps(_mm512_set1_ps(points[depth + d]), b, c1);
+        c2 = _mm512_fmadd_ps(_mm512_set1_ps(points[2 * depth + d]), b, c2);
+        c3 = _mm512_fmadd_ps(_mm512_set1_ps(points[3 * depth + d]), b, c3);
+    }
+    _mm512_storeu_ps(dots, c0);
+    _mm512_storeu_ps(dots + kGemmColumns, c1);
+    _mm512_storeu_ps(dots + 2 * kGemmColumns, c2);
+    _mm512_storeu_ps(dots + 3 * kGemmColumns, c3);
+}
+
+// Assignment kernel selected at runtime for coordinate type T. Returns index
+// of the nearest centroid and stores squared distance to it.
+template <class T>
+struct NearestCentroidKernel {
+    typedef size_t (*Function)(const CentroidsTable<T>& centroids, const T* point,
+                               T* min_distance_sqr);
+    static Function function;
+};
+
+template <class T>
+typename NearestCentroidKernel<T>::Function NearestCentroidKernel<T>::function =
+    NearestCentroidScalar<T>;
+
+// Register block kernel of GEMM assignment selected together with the above
+template <class T>
+struct DotBlockKernel {
+    typedef void (*Function)(const T* points, size_t depth, const T* centroids_t, size_t stride,
+                             T* dots);
+    static Function function;
+};
+
+template <class T>
+typename DotBlockKernel<T>::Function DotBlockKernel<T>::function = DotBlockScalar<T>;
+
+template <class T>
+void SetNearestCentroidKernel(const std::string& name) {
+    typedef size_t (*Function)(const CentroidsTable<T>&, const T*, T*);
+    typedef void (*DotFunction)(const T*, size_t, const T*, size_t, T*);
+    if (name == "avx512") {
+        NearestCentroidKernel<T>::function = static_cast<Function>(NearestCentroidAvx512);
+        DotBlockKernel<T>::function = static_cast<DotFunction>(DotBlockAvx512);
+    } else if (name == "avx2") {
+        NearestCentroidKernel<T>::function = static_cast<Function>(NearestCentroidAvx2);
+        DotBlockKernel<T>::function = static_cast<DotFunction>(DotBlockAvx2);
+    } else {
+        NearestCentroidKernel<T>::function = NearestCentroidScalar<T>;
+        DotBlockKernel<T>::function = DotBlockScalar<T>;
+    }
+}
+
+// Selects assignment kernels by name, "auto" picks the widest one supported by CPU
+inline bool SelectNearestCentroidKernel(std::string name) {
+    __builtin_cpu_init();
+    bool has_avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    bool has_avx512 = __builtin_cpu_supports("avx512f");
+    if (name == "auto") {
+        name = has_avx512 ? "avx512" : (has_avx2 ? "avx2" : "scalar");
+    }
+    if (!(name == "scalar" || (name == "avx2" && has_avx2) || (name == "avx512" && has_avx512))) {
+        return false;
+    }
+    SetNearestCentroidKernel<double>(name);
+    SetNearestCentroidKernel<float>(name);
+    return true;
+}
+
+template <class T>
+size_t FindNearestCentroid(const CentroidsTable<T>& centroids, const T* point,
+                           T* min_distance_sqr) {
+    return NearestCentroidKernel<T>::function(centroids, point, min_distance_sqr);
+}
+
+// Streams of empty cluster relocation, one per iteration, kept apart from
+// streams used by seeding
+const uint64_t kRelocationStream = 1ULL << 62;
+
+// Calculates new position of centroid k as mean of positions of 3 random
+// centroids, drawn from counter-based stream of given iteration so that runs
+// going at once don't share random state
+template <class A>
+void GetRandomPosition(const BasicPoints<A>& centroids, uint64_t seed, size_t iteration, size_t k,
+                       A* new_position) {
+    size_t K = centroids.Size();
+    uint64_t stream = kRelocationStream + iteration;
+    size_t c1 = HashRandom(seed, stream, 3 * k) % K;
+    size_t c2 = HashRandom(seed, stream, 3 * k + 1) % K;
+    size_t c3 = HashRandom(seed, stream, 3 * k + 2) % K;
+    size_t dimensions = centroids.Dimensions();
+    for (size_t d = 0; d < dimensions; ++d) {
+        new_position[d] = (centroids(c1, d) + centroids(c2, d) + centroids(c3, d)) / 3;
+    }
+}
+
+// Initialize centroids randomly at data points
+template <class T>
+BasicPoints<T> InitCentroids(const BasicPoints<T>& data, size_t K) {
+    size_t data_size = data.Size();
+    BasicPoints<T> centroids(K, data.Dimensions());
+    for (size_t i = 0; i < K; ++i) {
+        data.CopyPoint(UniformRandom(data_size - 1), centroids.Row(i));
+    }
+    return centroids;
+}
+
+// Weights are summed over fixed size blocks which are then added up in order,
+// which keeps sums independent of number of threads
+const size_t kSeedingBlock = 4096;
+
+// Picks index with probability proportional to its weight given uniform u
+inline size_t SampleByWeight(const std::vector<double>& weights, const std::vector<double>& block_sums,
+                             double total, double u) {
+    double target = u * total;
+    size_t block = 0;
+    while (block + 1 < block_sums.size() && target >= block_sums[block]) {
+        target -= block_sums[block];
+        ++block;
+    }
+    size_t begin = block * kSeedingBlock;
+    size_t end = std::min(begin + kSeedingBlock, weights.size());
+    size_t last_positive = begin;
+    for (size_t i = begin; i < end; ++i) {
+        if (weights[i] > 0) {
+            last_positive = i;
+            if (target < weights[i]) {
+                return i;
+            }
+            target -= weights[i];
+        }
+    }
+    // Rounding may leave small remainder after the last point
+    return last_positive;
+}
+
+// Lowers distances to the nearest chosen centroid using new centroids
+// [first, last) and returns their sum, computed blockwise into block_sums
+template <class T>
+double UpdateSeedingDistances(const BasicPoints<T>& data, const BasicPoints<T>& centroids,
+                              size_t first, size_t last, std::vector<double>* distances,
+                              std::vector<double>* block_sums) {
+    size_t data_size = data.Size();
+    size_t dimensions = data.Dimensions();
+    size_t blocks = block_sums->size();
+    #pragma omp parallel
+    {
+        std::vector<T> buffer(dimensions);
+        #pragma omp for schedule(static)
+        for (size_t block = 0; block < blocks; ++block) {
+            size_t end = std::min((block + 1) * kSeedingBlock, data_size);
+            double sum = 0;
+            for (size_t i = block * kSeedingBlock; i < end; ++i) {
+                const T* point = data.GetPoint(i, buffer.data());
+                double& distance = (*distances)[i];
+                for (size_t c = first; c < last; ++c) {
+                    distance = std::min<double>(distance,
+                                                SquaredDistance(point, centroids.Row(c), dimensions));
+                }
+                sum += distance;
+            }
+            (*block_sums)[block] = sum;
+        }
+    }
+    double total = 0;
+    for (size_t block = 0; block < blocks; ++block) {
+        total += (*block_sums)[block];
+    }
+    return total;
+}
+
+/*
+    k-means++ seeding (Arthur and Vassilvitskii): first centroid is a random
+    point, every next one is a point sampled with probability proportional to
+    squared distance to the nearest centroid chosen so far. Distances are
+    updated in parallel, sampling is deterministic for a given seed.
+*/
+template <class T>
+BasicPoints<T> KMeansPlusPlus(const BasicPoints<T>& data, size_t K, uint64_t seed) {
+    size_t data_size = data.Size();
+    BasicPoints<T> centroids(K, data.Dimensions());
+    std::vector<double> distances(data_size, std::numeric_limits<double>::infinity());
+    std::vector<double> block_sums((data_size + kSeedingBlock - 1) / kSeedingBlock);
+
+    data.CopyPoint(HashRandom(seed, 0, 0) % data_size, centroids.Row(0));
+    for (size_t k = 1; k < K; ++k) {
+        double total = UpdateSeedingDistances(data, centroids, k - 1, k, &distances, &block_sums);
+        size_t chosen;
+        if (total > 0) {
+            chosen = SampleByWeight(distances, block_sums, total, HashUniform01(seed, k, 0));
+        } else {
+            // Every point coincides with some centroid
+            chosen = HashRandom(seed, k, 0) % data_size;
+        }
+        data.CopyPoint(chosen, centroids.Row(k));
+    }
+    return centroids;
+}
+
+/*
+    Scalable k-means|| seeding (Bahmani et al.): instead of K sequential passes
+    do a few rounds, each sampling every point independently with probability
+    oversampling * distance / total. Candidates are weighted by the number of
+    points closest to them and reduced to K centroids by weighted k-means++.
+*/
+template <class T>
+BasicPoints<T> KMeansParallel(const BasicPoints<T>& data, size_t K, uint64_t seed,
+                              size_t rounds = 5, double oversampling_factor = 2) {
+    size_t data_size = data.Size();
+    size_t dimensions = data.Dimensions();
+    double oversampling = oversampling_factor * K;
+    std::vector<double> distances(data_size, std::numeric_limits<double>::infinity());
+    std::vector<double> block_sums((data_size + kSeedingBlock - 1) / kSeedingBlock);
+
+    std::vector<size_t> candidates(1, HashRandom(seed, 0, 0) % data_size);
+    BasicPoints<T> candidates_points(1, dimensions);
+    data.CopyPoint(candidates[0], candidates_points.Row(0));
+    double total = UpdateSeedingDistances(data, candidates_points, 0, 1, &distances, &block_sums);
+
+    for (size_t round = 1; round <= rounds && total > 0; ++round) {
+        size_t first_new = candidates.size();
+        #pragma omp parallel
+        {
+            std::vector<size_t> sampled;
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < data_size; ++i) {
+                if (HashUniform01(seed, round, i) * total < oversampling * distances[i]) {
+                    sampled.push_back(i);
+                }
+            }
+            #pragma omp critical
+            candidates.insert(candidates.end(), sampled.begin(), sampled.end());
+        }
+        // Threads append in arbitrary order, sorting makes candidates deterministic
+        std::sort(candidates.begin() + first_new, candidates.end());
+
+        BasicPoints<T> extended(candidates.size(), dimensions);
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            data.CopyPoint(candidates[c], extended.Row(c));
+        }
+        candidates_points.Swap(extended);
+        total = UpdateSeedingDistances(data, candidates_points, first_new, candidates.size(),
+                                       &distances, &block_sums);
+    }
+
+    // Weight of candidate is the number of points for which it is the nearest
+    size_t candidates_size = candidates.size();
+    std::vector<double> weights(candidates_size);
+    #pragma omp parallel
+    {
+        std::vector<double> local_weights(candidates_size);
+        std::vector<T> buffer(dimensions);
+        #pragma omp for schedule(static) nowait
+        for (size_t i = 0; i < data_size; ++i) {
+            const T* point = data.GetPoint(i, buffer.data());
+            size_t nearest = 0;
+            T min_distance = std::numeric_limits<T>::infinity();
+            for (size_t c = 0; c < candidates_size; ++c) {
+                T distance = SquaredDistance(point, candidates_points.Row(c), dimensions);
+                if (distance < min_distance) {
+                    min_distance = distance;
+                    nearest = c;
+                }
+            }
+            local_weights[nearest] += 1;
+        }
+        // Counts are integers, so the order of additions doesn't matter
+        #pragma omp critical
+        for (size_t c = 0; c < candidates_size; ++c) {
+            weights[c] += local_weights[c];
+        }
+    }
+
+    // Weighted k-means++ over candidates, serial as there are only about
+    // rounds * oversampling of them
+    BasicPoints<T> centroids(K, dimensions);
+    std::vector<double> candidate_distances(candidates_size, std::numeric_limits<double>::infinity());
+    std::vector<double> scores(candidates_size);
+    std::vector<double> score_sums((candidates_size + kSeedingBlock - 1) / kSeedingBlock);
+    // The first centroid is sampled by weights alone, block sums of weights
+    // add up to data_size
+    for (size_t c = 0; c < candidates_size; ++c) {
+        score_sums[c / kSeedingBlock] += weights[c];
+    }
+    size_t chosen = SampleByWeight(weights, score_sums, data_size, HashUniform01(seed, rounds + 1, 0));
+    for (size_t k = 0; k < K; ++k) {
+        if (k > 0) {
+            std::fill(score_sums.begin(), score_sums.end(), 0.0);
+            double score_total = 0;
+            for (size_t c = 0; c < candidates_size; ++c) {
+                double distance = SquaredDistance(candidates_points.Row(c), centroids.Row(k - 1), dimensions);
+                candidate_distances[c] = std::min(candidate_distances[c], distance);
+                scores[c] = weights[c] * candidate_distances[c];
+                score_sums[c / kSeedingBlock] += scores[c];
+                score_total += scores[c];
+            }
+            if (score_total > 0) {
+                chosen = SampleByWeight(scores, score_sums, score_total,
+                                        HashUniform01(seed, rounds + 1, k));
+            } else {
+                // Fewer distinct candidates than clusters
+                data.CopyPoint(HashRandom(seed, rounds + 1, k) % data_size, centroids.Row(k));
+                continue;
+            }
+        }
+        std::copy(candidates_points.Row(chosen), candidates_points.Row(chosen) + dimensions,
+                  centroids.Row(k));
+    }
+    return centroids;
+}
+
+// Creates initial centroids with given seeding method, prints error and
+// returns false for unknown name, no points or no clusters
+template <class T>
+bool SeedCentroids(const BasicPoints<T>& data, size_t K, const std::string& method, uint64_t seed,
+                   BasicPoints<T>* centroids) {
+    if (data.Size() == 0 || K == 0) {
+        std::cerr << "Error: seeding needs at least one point and one cluster" << std::endl;
+        return false;
+    }
+    if (method == "random") {
+        *centroids = InitCentroids(data, K);
+    } else if (method == "kmeans++") {
+        *centroids = KMeansPlusPlus(data, K, seed);
+    } else if (method == "kmeans||") {
+        *centroids = KMeansParallel(data, K, seed);
+    } else {
+        std::cerr << "Error: unknown seeding method " << method << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Per-thread partial sums and sizes of clusters. Every thread owns a separate
+// slab padded to cache line, so accumulation needs no synchronization and
+// threads never share lines. Slabs are merged in thread order, which makes
+// result bit-reproducible for a fixed number of threads and static schedule.
+//
+// With update period above 1 only points which changed cluster are
+// accumulated: slabs collect differences which are applied to running sums
+// kept between passes, and every update_period-th pass recomputes sums from
+// all points to bound rounding drift. Counts differences are added modulo
+// 2^64, which still gives exact sizes.
+template <class A>
+class ClusterAccumulator {
+public:
+    ClusterAccumulator(size_t K, size_t dimensions, size_t update_period = 1)
+        : K_(K), dimensions_(dimensions), update_period_(std::max<size_t>(update_period, 1)),
+          pass_(0), full_pass_(true), threads_(0),
+          sums_(omp_get_max_threads(), PadToLine<A>(K * dimensions)),
+          counts_(omp_get_max_threads(), PadToLine<size_t>(K)),
+          thread_times_(omp_get_max_threads(), PadToLine<double>(2)) {
+        if (update_period_ > 1) {
+            running_sums_.Assign(K, dimensions);
+            running_counts_.assign(K, 0);
+        }
+    }
+
+    // Zeroes partial sums of the calling thread, call inside parallel region
+    // before the first Add so slab is first touched by its owner
+    void Clear(size_t thread) {
+        thread_times_(thread, 0) = omp_get_wtime();
+        std::fill(sums_.Row(thread), sums_.Row(thread) + sums_.Dimensions(), A(0));
+        std::fill(counts_.Row(thread), counts_.Row(thread) + counts_.Dimensions(), size_t(0));
+    }
+
+    // Accounts point which moved from previous cluster (K if unassigned) to
+    // given one
+    template <class T>
+    void Add(size_t thread, size_t previous_cluster, size_t cluster, const T* point) {
+        if (full_pass_) {
+            Add(thread, cluster, point, 1);
+        } else if (previous_cluster != cluster) {
+            if (previous_cluster < K_) {
+                Add(thread, previous_cluster, point, -1);
+            }
+            Add(thread, cluster, point, 1);
+        }
+    }
+
+    // Merges slabs of the whole team into cluster sums and sizes. Must be
+    // called by every thread of the parallel region after its last Add
+    void Merge(BasicPoints<A>* sums, std::vector<size_t>* sizes) {
+        size_t threads = omp_get_num_threads();
+        size_t thread = omp_get_thread_num();
+        thread_times_(thread, 1) = omp_get_wtime() - thread_times_(thread, 0);
+        #pragma omp barrier
+        #pragma omp for schedule(static)
+        for (size_t k = 0; k < K_; ++k) {
+            Merge(k, threads, sums->Row(k), &(*sizes)[k]);
+            if (update_period_ > 1) {
+                A* running_sum = running_sums_.Row(k);
+                for (size_t d = 0; d < dimensions_; ++d) {
+                    running_sum[d] = full_pass_ ? (*sums)(k, d) : running_sum[d] + (*sums)(k, d);
+                    (*sums)(k, d) = running_sum[d];
+                }
+                running_counts_[k] = full_pass_ ? (*sizes)[k] : running_counts_[k] + (*sizes)[k];
+                (*sizes)[k] = running_counts_[k];
+            }
+        }
+        #pragma omp single
+        {
+            ++pass_;
+            full_pass_ = pass_ % update_period_ == 0;
+            threads_ = threads;
+        }
+    }
+
+    // Seconds every thread of the last pass spent between Clear and Merge,
+    // steps run their loops without barrier so this is thread's own work
+    std::vector<double> ThreadTimes() const {
+        std::vector<double> times(threads_);
+        for (size_t thread = 0; thread < threads_; ++thread) {
+            times[thread] = thread_times_(thread, 1);
+        }
+        return times;
+    }
+
+    // Adds up partial results of the first threads slabs for given cluster
+    void Merge(size_t cluster, size_t threads, A* sum, size_t* size) const {
+        std::fill(sum, sum + dimensions_, A(0));
+        *size = 0;
+        for (size_t thread = 0; thread < threads; ++thread) {
+            const A* partial = sums_.Row(thread) + cluster * dimensions_;
+            for (size_t d = 0; d < dimensions_; ++d) {
+                sum[d] += partial[d];
+            }
+            *size += counts_.Row(thread)[cluster];
+        }
+    }
+
+private:
+    template <class U>
+    static size_t PadToLine(size_t length) {
+        size_t per_line = BasicPoints<U>::kAlignment / sizeof(U);
+        return (length + per_line - 1) / per_line * per_line;
+    }
+
+    template <class T>
+    void Add(size_t thread, size_t cluster, const T* point, int sign) {
+        A* sum = sums_.Row(thread) + cluster * dimensions_;
+        for (size_t d = 0; d < dimensions_; ++d) {
+            sum[d] += sign * point[d];
+        }
+        counts_.Row(thread)[cluster] += sign;
+    }
+
+    size_t K_;
+    size_t dimensions_;
+    size_t update_period_;
+    size_t pass_;
+    bool full_pass_;
+    size_t threads_;
+    BasicPoints<A> sums_;
+    BasicPoints<size_t> counts_;
+    BasicPoints<double> thread_times_;  // start and duration, line per thread
+    BasicPoints<A> running_sums_;
+    std::vector<size_t> running_counts_;
+};
+
+// Turns cluster sums into means, empty clusters are moved to random position
+// derived from previous centroids
+template <class A>
+void UpdateCentroids(const BasicPoints<A>& centroids, const std::vector<size_t>& clusters_sizes,
+                     uint64_t seed, size_t iteration, BasicPoints<A>* nextCentroids) {
+    size_t dimensions = centroids.Dimensions();
+    for (size_t i = 0; i < centroids.Size(); ++i) {
+        if (clusters_sizes[i] != 0) {
+            for (size_t d = 0; d < dimensions; ++d) {
+                (*nextCentroids)(i, d) /= clusters_sizes[i];
+            }
+        } else {
+            GetRandomPosition(centroids, seed, iteration, i, nextCentroids->Row(i));
+        }
+    }
+}
+
+// Conditions to stop iterating, checked after every centroids update. Each
+// criterion fires when measured value is not above its threshold, negative
+// threshold disables it.
+struct StoppingCriteria {
+    StoppingCriteria()
+        : max_iterations(100), max_shift(0), reassigned_fraction(0), inertia_change(-1) {
+    }
+
+    size_t max_iterations;
+    double max_shift;            // largest distance some centroid moved
+    double reassigned_fraction;  // share of points which changed cluster
+    double inertia_change;       // relative change of sum of squared distances
+};
+
+enum StopReason {
+    POINTS_REASSIGNED,
+    CENTROIDS_SHIFT,
+    INERTIA_CHANGE,
+    MAX_ITERATIONS
+};
+
+inline const char* StopReasonName(StopReason reason) {
+    switch (reason) {
+        case POINTS_REASSIGNED:
+            return "reassigned points fraction";
+        case CENTROIDS_SHIFT:
+            return "centroids shift";
+        case INERTIA_CHANGE:
+            return "inertia change";
+        case MAX_ITERATIONS:
+            return "iterations limit";
+    }
+    return "unknown";
+}
+
+struct KMeansResult {
+    std::vector<size_t> clusters;
+    Points centroids;
+    size_t iterations;
+    double inertia;  // sum of squared distances to final centroids
+    StopReason stop_reason;
+    double assign_time;  // seconds spent in assignment steps and bounds updates
+    double update_time;  // seconds spent in centroids updates
+};
+
+// Assignment step of k-means iteration: labels every point with its nearest
+// centroid and sums points of every cluster
+template <class T, class A>
+class AssignmentStep {
+public:
+    virtual ~AssignmentStep() {
+    }
+
+    // Returns number of points which changed cluster. Unassigned points are
+    // marked with cluster K. Inertia against given centroids is computed only
+    // when requested.
+    virtual size_t Assign(const BasicPoints<A>& centroids, std::vector<size_t>* clusters,
+                          BasicPoints<A>* sums, std::vector<size_t>* clusters_sizes,
+                          double* inertia) = 0;
+
+    // Number of points labelled by the step, used for reassigned fraction
+    virtual size_t PointsNumber() const = 0;
+
+    // Called after centroids update with distance every centroid moved
+    virtual void CentroidsMoved(const std::vector<size_t>& clusters,
+                                const std::vector<double>& movement) {
+    }
+
+    // Seconds of the last Assign spent by every thread on its own points
+    virtual std::vector<double> ThreadTimes() const = 0;
+
+    // Prints engine specific statistics to stderr
+    virtual void Report() const {
+    }
+
+    // Point to centroid distances computed so far by engines which prune
+    // them, zero for engines which don't count
+    virtual size_t DistanceComputations() const {
+        return 0;
+    }
+};
+
+// Plain Lloyd assignment: every point is compared with every centroid
+template <class T, class A>
+class LloydStep : public AssignmentStep<T, A> {
+public:
+    LloydStep(const BasicPoints<T>& data, size_t K, size_t update_period = 1)
+        : data_(data), accumulator_(K, data.Dimensions(), update_period) {
+    }
+
+    size_t Assign(const BasicPoints<A>& centroids, std::vector<size_t>* clusters,
+                  BasicPoints<A>* sums, std::vector<size_t>* clusters_sizes, double* inertia) {
+        size_t data_size = data_.Size();
+        size_t dimensions = data_.Dimensions();
+        size_t reassigned = 0;
+        double inertia_sum = 0;
+
+        #pragma omp parallel reduction(+:reassigned, inertia_sum)
+        {
+            size_t thread = omp_get_thread_num();
+            std::vector<T> buffer(dimensions);
+            tables_.Load([&](CentroidsTable<T>* table) { table->Load(centroids); });
+            const CentroidsTable<T>& table = tables_.Local();
+            accumulator_.Clear(thread);
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < data_size; ++i) {
+                const T* point = data_.GetPoint(i, buffer.data());
+                T distance_sqr;
+                size_t nearest_cluster = FindNearestCentroid(table, point, &distance_sqr);
+                size_t previous_cluster = (*clusters)[i];
+                if (previous_cluster != nearest_cluster) {
+                    (*clusters)[i] = nearest_cluster;
+                    ++reassigned;
+                }
+                inertia_sum += distance_sqr;
+                accumulator_.Add(thread, previous_cluster, nearest_cluster, point);
+            }
+            accumulator_.Merge(sums, clusters_sizes);
+        }
+        if (inertia != nullptr) {
+            *inertia = inertia_sum;
+        }
+        return reassigned;
+    }
+
+    size_t PointsNumber() const {
+        return data_.Size();
+    }
+
+    std::vector<double> ThreadTimes() const {
+        return accumulator_.ThreadTimes();
+    }
+
+private:
+    const BasicPoints<T>& data_;
+    SocketReplicas<CentroidsTable<T> > tables_;
+    ClusterAccumulator<A> accumulator_;
+};
+
+// Finds nearest and second nearest centroids of the point by full scan
+template <class T>
+void FindTwoNearestCentroids(const BasicPoints<T>& centroids, const T* point, size_t* nearest,
+                             T* nearest_distance, T* second_distance) {
+    size_t dimensions = centroids.Dimensions();
+    T best = std::numeric_limits<T>::infinity();
+    T second = std::numeric_limits<T>::infinity();
+    size_t best_index = 0;
+    for (size_t k = 0; k < centroids.Size(); ++k) {
+        T distance = SquaredDistance(point, centroids.Row(k), dimensions);
+        if (distance < best) {
+            second = best;
+            best = distance;
+            best_index = k;
+        } else if (distance < second) {
+            second = distance;
+        }
+    }
+    *nearest = best_index;
+    *nearest_distance = std::sqrt(best);
+    *second_distance = std::sqrt(second);
+}
+
+/*
+    Hamerly's algorithm: exact Lloyd iterations which skip distance computations
+    using triangle inequality. For every point we keep an upper bound on distance
+    to its centroid and a lower bound on distance to any other centroid. Point
+    can't change cluster while upper bound is below both the lower bound and half
+    the distance from its centroid to the closest other centroid. Bounds are
+    loosened by centroid movements after each update.
+*/
+template <class T, class A>
+class HamerlyStep : public AssignmentStep<T, A> {
+public:
+    HamerlyStep(const BasicPoints<T>& data, size_t K, size_t update_period = 1)
+        : data_(data), upper_(data.Size()), lower_(data.Size()), half_separation_(K),
+          accumulator_(K, data.Dimensions(), update_period), distance_computations_(0) {
+    }
+
+    size_t Assign(const BasicPoints<A>& centroids_sums_type, std::vector<size_t>* clusters,
+                  BasicPoints<A>* sums, std::vector<size_t>* clusters_sizes, double* inertia) {
+        size_t data_size = data_.Size();
+        size_t dimensions = data_.Dimensions();
+        size_t K = centroids_sums_type.Size();
+        centroids_.AssignFrom(centroids_sums_type);
+
+        for (size_t k = 0; k < K; ++k) {
+            half_separation_[k] = std::numeric_limits<T>::infinity();
+        }
+        for (size_t k = 0; k < K; ++k) {
+            for (size_t j = k + 1; j < K; ++j) {
+                T half_distance = Distance(centroids_.Row(k), centroids_.Row(j), dimensions) / 2;
+                half_separation_[k] = std::min(half_separation_[k], half_distance);
+                half_separation_[j] = std::min(half_separation_[j], half_distance);
+            }
+        }
+
+        size_t reassigned = 0;
+        size_t distance_computations = 0;
+        double inertia_sum = 0;
+        #pragma omp parallel reduction(+:reassigned, distance_computations, inertia_sum)
+        {
+            size_t thread = omp_get_thread_num();
+            std::vector<T> buffer(dimensions);
+            local_centroids_.Load([&](BasicPoints<T>* copy) { *copy = centroids_; });
+            const BasicPoints<T>& centroids = local_centroids_.Local();
+            accumulator_.Clear(thread);
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < data_size; ++i) {
+                const T* point = data_.GetPoint(i, buffer.data());
+                size_t cluster = (*clusters)[i];
+                bool exact = false;
+                if (cluster == K) {
+                    FindTwoNearestCentroids(centroids, point, &(*clusters)[i], &upper_[i], &lower_[i]);
+                    distance_computations += K;
+                    exact = true;
+                } else {
+                    T bound = std::max(half_separation_[cluster], lower_[i]);
+                    if (upper_[i] > bound) {
+                        upper_[i] = Distance(point, centroids.Row(cluster), dimensions);
+                        ++distance_computations;
+                        exact = true;
+                        if (upper_[i] > bound) {
+                            FindTwoNearestCentroids(centroids, point, &(*clusters)[i], &upper_[i], &lower_[i]);
+                            distance_computations += K;
+                        }
+                    }
+                }
+                if ((*clusters)[i] != cluster) {
+                    ++reassigned;
+                }
+                if (inertia != nullptr) {
+                    if (!exact) {
+                        upper_[i] = Distance(point, centroids.Row((*clusters)[i]), dimensions);
+                        ++distance_computations;
+                    }
+                    inertia_sum += upper_[i] * upper_[i];
+                }
+                accumulator_.Add(thread, cluster, (*clusters)[i], point);
+            }
+            accumulator_.Merge(sums, clusters_sizes);
+        }
+        distance_computations_ += distance_computations;
+        if (inertia != nullptr) {
+            *inertia = inertia_sum;
+        }
+        return reassigned;
+    }
+
+    size_t PointsNumber() const {
+        return data_.Size();
+    }
+
+    std::vector<double> ThreadTimes() const {
+        return accumulator_.ThreadTimes();
+    }
+
+    void CentroidsMoved(const std::vector<size_t>& clusters, const std::vector<double>& movement) {
+        // Every lower bound is loosened by the largest movement of other centroids
+        size_t K = movement.size();
+        size_t farthest = 0;
+        double second_movement = 0;
+        for (size_t k = 1; k < K; ++k) {
+            if (movement[k] > movement[farthest]) {
+                second_movement = movement[farthest];
+                farthest = k;
+            } else if (movement[k] > second_movement) {
+                second_movement = movement[k];
+            }
+        }
+        size_t data_size = data_.Size();
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < data_size; ++i) {
+            upper_[i] += movement[clusters[i]];
+            lower_[i] -= (clusters[i] == farthest) ? second_movement : movement[farthest];
+        }
+    }
+
+    void Report() const {
+        std::cerr << "Distance computations: " << distance_computations_ << std::endl;
+    }
+
+    size_t DistanceComputations() const {
+        return distance_computations_;
+    }
+
+private:
+    const BasicPoints<T>& data_;
+    BasicPoints<T> centroids_;
+    SocketReplicas<BasicPoints<T> > local_centroids_;
+    std::vector<T> upper_;
+    std::vector<T> lower_;
+    std::vector<T> half_separation_;
+    ClusterAccumulator<A> accumulator_;
+    size_t distance_computations_;
+};
+
+/*
+    Assignment through expansion |x - c|^2 = |x|^2 - 2 x.c + |c|^2. Cross terms
+    of a tile of points with all centroids are a small matrix product computed
+    in register blocks of kGemmRows x kGemmColumns, and every block is reduced
+    to the running nearest centroid right away, so distances are never stored.
+    Point norms are computed once. Points tile is packed to contiguous rows and
+    reused for all centroid blocks, centroids are transposed and padded with
+    zero coordinates and infinite norms. Pays off in many dimensions; in few
+    dimensions the expansion only adds rounding error.
+*/
+template <class T, class A>
+class GemmStep : public AssignmentStep<T, A> {
+public:
+    static const size_t kTilePoints = 64;
+
+    GemmStep(const BasicPoints<T>& data, size_t K, size_t update_period = 1)
+        : data_(data), point_norms_(data.Size()), accumulator_(K, data.Dimensions(), update_period) {
+        size_t data_size = data_.Size();
+        size_t dimensions = data_.Dimensions();
+        #pragma omp parallel
+        {
+            std::vector<T> buffer(dimensions);
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < data_size; ++i) {
+                const T* point = data_.GetPoint(i, buffer.data());
+                T norm = 0;
+                for (size_t d = 0; d < dimensions; ++d) {
+                    norm += point[d] * point[d];
+                }
+                point_norms_[i] = norm;
+            }
+        }
+    }
+
+    size_t Assign(const BasicPoints<A>& centroids, std::vector<size_t>* clusters,
+                  BasicPoints<A>* sums, std::vector<size_t>* clusters_sizes, double* inertia) {
+        size_t data_size = data_.Size();
+        size_t dimensions = data_.Dimensions();
+        size_t K = centroids.Size();
+        size_t stride = (K + kGemmColumns - 1) / kGemmColumns * kGemmColumns;
+        size_t tiles = (data_size + kTilePoints - 1) / kTilePoints;
+        size_t reassigned = 0;
+        double inertia_sum = 0;
+        #pragma omp parallel reduction(+:reassigned, inertia_sum)
+        {
+            size_t thread = omp_get_thread_num();
+            BasicPoints<T> tile(kTilePoints, dimensions);
+            T dots[kGemmRows * kGemmColumns];
+            T best[kTilePoints];
+            size_t best_index[kTilePoints];
+            local_centroids_.Load([&](TransposedCentroids* copy) { copy->Load(centroids, stride); });
+            const BasicPoints<T>& centroids_t = local_centroids_.Local().coords;
+            const std::vector<T>& centroid_norms = local_centroids_.Local().norms;
+            accumulator_.Clear(thread);
+            #pragma omp for schedule(static) nowait
+            for (size_t t = 0; t < tiles; ++t) {
+                size_t begin = t * kTilePoints;
+                size_t count = std::min(kTilePoints, data_size - begin);
+                for (size_t r = 0; r < count; ++r) {
+                    data_.CopyPoint(begin + r, tile.Row(r));
+                    best[r] = std::numeric_limits<T>::infinity();
+                    best_index[r] = 0;
+                }
+                // Rows past the end are zero and their results ignored
+                size_t rows = (count + kGemmRows - 1) / kGemmRows * kGemmRows;
+                for (size_t r = count; r < rows; ++r) {
+                    std::fill(tile.Row(r), tile.Row(r) + dimensions, T(0));
+                }
+                for (size_t k = 0; k < stride; k += kGemmColumns) {
+                    for (size_t r = 0; r < rows; r += kGemmRows) {
+                        DotBlockKernel<T>::function(tile.Row(r), dimensions,
+                                                    centroids_t.Row(0) + k, stride, dots);
+                        size_t last = std::min(kGemmRows, count - std::min(count, r));
+                        for (size_t row = 0; row < last; ++row) {
+                            for (size_t j = 0; j < kGemmColumns; ++j) {
+                                T distance = centroid_norms[k + j] - 2 * dots[row * kGemmColumns + j];
+                                if (distance < best[r + row]) {
+                                    best[r + row] = distance;
+                                    best_index[r + row] = k + j;
+                                }
+                            }
+                        }
+                    }
+                }
+                for (size_t r = 0; r < count; ++r) {
+                    size_t i = begin + r;
+                    size_t previous_cluster = (*clusters)[i];
+                    if (previous_cluster != best_index[r]) {
+                        (*clusters)[i] = best_index[r];
+                        ++reassigned;
+                    }
+                    // Cancellation may leave tiny negative distance
+                    inertia_sum += std::max(point_norms_[i] + best[r], T(0));
+                    accumulator_.Add(thread, previous_cluster, best_index[r], tile.Row(r));
+                }
+            }
+            accumulator_.Merge(sums, clusters_sizes);
+        }
+        if (inertia != nullptr) {
+            *inertia = inertia_sum;
+        }
+        return reassigned;
+    }
+
+    size_t PointsNumber() const {
+        return data_.Size();
+    }
+
+    std::vector<double> ThreadTimes() const {
+        return accumulator_.ThreadTimes();
+    }
+
+private:
+    // Centroids transposed to dimensions x stride and their squared norms
+    struct TransposedCentroids {
+        void Load(const BasicPoints<A>& centroids, size_t stride) {
+            size_t K = centroids.Size();
+            size_t dimensions = centroids.Dimensions();
+            coords.Assign(dimensions, stride);
+            norms.assign(stride, std::numeric_limits<T>::infinity());
+            for (size_t k = 0; k < K; ++k) {
+                T norm = 0;
+                for (size_t d = 0; d < dimensions; ++d) {
+                    T coordinate = static_cast<T>(centroids(k, d));
+                    coords(d, k) = coordinate;
+                    norm += coordinate * coordinate;
+                }
+                norms[k] = norm;
+            }
+        }
+
+        BasicPoints<T> coords;
+        std::vector<T> norms;
+    };
+
+    const BasicPoints<T>& data_;
+    std::vector<T> point_norms_;
+    SocketReplicas<TransposedCentroids> local_centroids_;
+    ClusterAccumulator<A> accumulator_;
+};
+
+// k-d tree over centroids answering exact nearest centroid queries. Nodes
+// split the widest coordinate at the median, leaves hold up to kLeafSize
+// centroids stored contiguously in tree order.
+template <class T>
+class CentroidsKdTree {
+public:
+    static const size_t kLeafSize = 8;
+    static const size_t kMaxDepth = 64;
+
+    template <class A>
+    void Build(const BasicPoints<A>& centroids) {
+        size_t K = centroids.Size();
+        original_.AssignFrom(centroids);
+        index_.resize(K);
+        for (size_t k = 0; k < K; ++k) {
+            index_[k] = k;
+        }
+        nodes_.clear();
+        BuildNode(0, K);
+        points_.Assign(K, original_.Dimensions());
+        for (size_t j = 0; j < K; ++j) {
+            original_.CopyPoint(index_[j], points_.Row(j));
+        }
+    }
+
+    // Returns index of the nearest centroid, ties go to the lowest index.
+    // Search starts from hint centroid when it is valid, which prunes most of
+    // the tree once clusters are stable.
+    size_t Nearest(const T* point, size_t hint, T* min_distance_sqr, size_t* distance_computations) const {
+        size_t dimensions = original_.Dimensions();
+        size_t K = original_.Size();
+        T best = std::numeric_limits<T>::infinity();
+        size_t best_index = K;
+        if (hint < K) {
+            best = SquaredDistance(point, original_.Row(hint), dimensions);
+            best_index = hint;
+            ++*distance_computations;
+        }
+        size_t stack_nodes[kMaxDepth + 1];
+        T stack_bounds[kMaxDepth + 1];
+        size_t stack_size = 1;
+        stack_nodes[0] = 0;
+        stack_bounds[0] = 0;
+        while (stack_size != 0) {
+            --stack_size;
+            const Node& node = nodes_[stack_nodes[stack_size]];
+            T bound = stack_bounds[stack_size];
+            if (bound > best) {
+                continue;
+            }
+            if (node.left == 0) {
+                for (size_t j = node.begin; j < node.end; ++j) {
+                    T distance = SquaredDistance(point, points_.Row(j), dimensions);
+                    if (distance < best || (distance == best && index_[j] < best_index)) {
+                        best = distance;
+                        best_index = index_[j];
+                    }
+                }
+                *distance_computations += node.end - node.begin;
+                continue;
+            }
+            T diff = point[node.split_dimension] - node.split_value;
+            // Far child is pushed first so the near one is visited first
+            stack_nodes[stack_size] = diff < 0 ? node.right : node.left;
+            stack_bounds[stack_size] = diff * diff;
+            stack_nodes[stack_size + 1] = diff < 0 ? node.left : node.right;
+            stack_bounds[stack_size + 1] = bound;
+            stack_size += 2;
+        }
+        *min_distance_sqr = best;
+        return best_index;
+    }
+
+private:
+    struct Node {
+        size_t begin;
+        size_t end;
+        size_t split_dimension;
+        T split_value;
+        size_t left;   // 0 for leaves, root is never a child
+        size_t right;
+    };
+
+    size_t BuildNode(size_t begin, size_t end) {
+        size_t node_index = nodes_.size();
+        nodes_.push_back(Node());
+        nodes_[node_index].begin = begin;
+        nodes_[node_index].end = end;
+        nodes_[node_index].left = 0;
+        if (end - begin <= kLeafSize) {
+            return node_index;
+        }
+        size_t dimensions = original_.Dimensions();
+        size_t split_dimension = 0;
+        T widest = -1;
+        for (size_t d = 0; d < dimensions; ++d) {
+            T low = std::numeric_limits<T>::infinity();
+            T high = -std::numeric_limits<T>::infinity();
+            for (size_t j = begin; j < end; ++j) {
+                low = std::min(low, original_(index_[j], d));
+                high = std::max(high, original_(index_[j], d));
+            }
+            if (high - low > widest) {
+                widest = high - low;
+                split_dimension = d;
+            }
+        }
+        size_t middle = begin + (end - begin) / 2;
+        const BasicPoints<T>& original = original_;
+        std::nth_element(index_.begin() + begin, index_.begin() + middle, index_.begin() + end,
+                         [&original, split_dimension](size_t a, size_t b) {
+                             return original(a, split_dimension) < original(b, split_dimension);
+                         });
+        nodes_[node_index].split_dimension = split_dimension;
+        nodes_[node_index].split_value = original_(index_[middle], split_dimension);
+        size_t left = BuildNode(begin, middle);
+        size_t right = BuildNode(middle, end);
+        nodes_[node_index].left = left;
+        nodes_[node_index].right = right;
+        return node_index;
+    }
+
+    BasicPoints<T> original_;
+    BasicPoints<T> points_;
+    std::vector<size_t> index_;
+    std::vector<Node> nodes_;
+};
+
+// Assignment through k-d tree rebuilt over centroids every iteration. Pays
+// off for many clusters in few dimensions, where most leaves are pruned.
+template <class T, class A>
+class KdTreeStep : public AssignmentStep<T, A> {
+public:
+    KdTreeStep(const BasicPoints<T>& data, size_t K, size_t update_period = 1)
+        : data_(data), accumulator_(K, data.Dimensions(), update_period), distance_computations_(0) {
+    }
+
+    size_t Assign(const BasicPoints<A>& centroids, std::vector<size_t>* clusters,
+                  BasicPoints<A>* sums, std::vector<size_t>* clusters_sizes, double* inertia) {
+        size_t data_size = data_.Size();
+        size_t dimensions = data_.Dimensions();
+        size_t reassigned = 0;
+        size_t distance_computations = 0;
+        double inertia_sum = 0;
+        tree_.Build(centroids);
+
+        #pragma omp parallel reduction(+:reassigned, distance_computations, inertia_sum)
+        {
+            size_t thread = omp_get_thread_num();
+            std::vector<T> buffer(dimensions);
+            accumulator_.Clear(thread);
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < data_size; ++i) {
+                const T* point = data_.GetPoint(i, buffer.data());
+                T distance_sqr;
+                size_t previous_cluster = (*clusters)[i];
+                size_t nearest_cluster = tree_.Nearest(point, previous_cluster, &distance_sqr,
+                                                       &distance_computations);
+                if (previous_cluster != nearest_cluster) {
+                    (*clusters)[i] = nearest_cluster;
+                    ++reassigned;
+                }
+                inertia_sum += distance_sqr;
+                accumulator_.Add(thread, previous_cluster, nearest_cluster, point);
+            }
+            accumulator_.Merge(sums, clusters_sizes);
+        }
+        distance_computations_ += distance_computations;
+        if (inertia != nullptr) {
+            *inertia = inertia_sum;
+        }
+        return reassigned;
+    }
+
+    size_t PointsNumber() const {
+        return data_.Size();
+    }
+
+    std::vector<double> ThreadTimes() const {
+        return accumulator_.ThreadTimes();
+    }
+
+    void Report() const {
+        std::cerr << "Distance computations: " << distance_computations_ << std::endl;
+    }
+
+    size_t DistanceComputations() const {
+        return distance_computations_;
+    }
+
+private:
+    const BasicPoints<T>& data_;
+    CentroidsKdTree<T> tree_;
+    ClusterAccumulator<A> accumulator_;
+    size_t distance_computations_;
+};
+
+// Sum of squared distances from points to centroids of their clusters,
+// always accumulated in double
+template <class T, class A>
+double Inertia(const BasicPoints<T>& data, const std::vector<size_t>& clusters,
+               const BasicPoints<A>& centroids) {
+    size_t data_size = data.Size();
+    size_t dimensions = data.Dimensions();
+    double inertia = 0;
+    #pragma omp parallel reduction(+:inertia)
+    {
+        std::vector<T> buffer(dimensions);
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < data_size; ++i) {
+            const T* point = data.GetPoint(i, buffer.data());
+            const A* centroid = centroids.Row(clusters[i]);
+            double distance_sqr = 0;
+            for (size_t d = 0; d < dimensions; ++d) {
+                double diff = static_cast<double>(point[d]) - centroid[d];
+                distance_sqr += diff * diff;
+            }
+            inertia += distance_sqr;
+        }
+    }
+    return inertia;
+}
+
+inline bool ShouldStop(const StoppingCriteria& criteria, size_t iteration, double reassigned_fraction,
+                       double max_shift, double inertia_change, StopReason* reason) {
+    if (reassigned_fraction <= criteria.reassigned_fraction) {
+        *reason = POINTS_REASSIGNED;
+    } else if (max_shift <= criteria.max_shift) {
+        *reason = CENTROIDS_SHIFT;
+    } else if (inertia_change <= criteria.inertia_change) {
+        *reason = INERTIA_CHANGE;
+    } else if (iteration >= criteria.max_iterations) {
+        *reason = MAX_ITERATIONS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Measurements of one k-means iteration
+struct IterationMetrics {
+    size_t iteration;
+    double begin_time;   // seconds since the start of the run
+    double assign_time;  // assignment step and bounds update
+    double update_time;
+    size_t reassigned;
+    double inertia;      // against centroids used for assignment
+    double max_shift;
+    size_t empty_clusters;
+    std::vector<double> thread_times;  // own work of every assigning thread
+
+    // Slowest thread time over the mean one, 1 means perfect balance
+    double Imbalance() const {
+        double sum = 0;
+        double slowest = 0;
+        for (size_t thread = 0; thread < thread_times.size(); ++thread) {
+            sum += thread_times[thread];
+            slowest = std::max(slowest, thread_times[thread]);
+        }
+        return sum > 0 ? slowest * thread_times.size() / sum : 1;
+    }
+};
+
+// Receives metrics of every iteration when passed to KMeans
+class IterationLog {
+public:
+    virtual ~IterationLog() {
+    }
+
+    virtual void Record(const IterationMetrics& metrics) = 0;
+};
+
+// One JSON object per iteration and line
+class JsonLinesLog : public IterationLog {
+public:
+    explicit JsonLinesLog(std::ostream& output) : output_(output) {
+    }
+
+    void Record(const IterationMetrics& metrics) {
+        output_ << "{\"iteration\": " << metrics.iteration
+                << ", \"assign_time\": " << metrics.assign_time
+                << ", \"update_time\": " << metrics.update_time
+                << ", \"reassigned\": " << metrics.reassigned
+                << ", \"inertia\": " << metrics.inertia
+                << ", \"max_shift\": " << metrics.max_shift
+                << ", \"empty_clusters\": " << metrics.empty_clusters
+                << ", \"imbalance\": " << metrics.Imbalance()
+                << ", \"thread_times\": [";
+        for (size_t thread = 0; thread < metrics.thread_times.size(); ++thread) {
+            output_ << (thread ? ", " : "") << metrics.thread_times[thread];
+        }
+        output_ << "]}\n";
+    }
+
+private:
+    std::ostream& output_;
+};
+
+// Chrome trace event format, open in chrome://tracing or Perfetto. Every
+// thread gets its assignment work as a slice, update is a slice of thread 0
+// and the rest of metrics are counters.
+class ChromeTraceLog : public IterationLog {
+public:
+    explicit ChromeTraceLog(std::ostream& output) : output_(output), events_(0) {
+        output_ << "[\n";
+    }
+
+    ~ChromeTraceLog() {
+        output_ << "\n]\n";
+    }
+
+    void Record(const IterationMetrics& metrics) {
+        double begin = metrics.begin_time * 1e6;
+        for (size_t thread = 0; thread < metrics.thread_times.size(); ++thread) {
+            Slice("assign", thread, begin, metrics.thread_times[thread] * 1e6, metrics.iteration);
+        }
+        Slice("update", 0, begin + metrics.assign_time * 1e6, metrics.update_time * 1e6,
+              metrics.iteration);
+        Separate();
+        output_ << "{\"name\": \"metrics\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << begin
+                << ", \"args\": {\"reassigned\": " << metrics.reassigned
+                << ", \"empty_clusters\": " << metrics.empty_clusters
+                << ", \"imbalance\": " << metrics.Imbalance() << "}}";
+        Separate();
+        output_ << "{\"name\": \"inertia\", \"ph\": \"C\", \"pid\": 0, \"ts\": " << begin
+                << ", \"args\": {\"inertia\": " << metrics.inertia
+                << ", \"max_shift\": " << metrics.max_shift << "}}";
+    }
+
+private:
+    void Separate() {
+        if (events_++ != 0) {
+            output_ << ",\n";
+        }
+    }
+
+    void Slice(const char* name, size_t thread, double begin, double duration, size_t iteration) {
+        Separate();
+        output_ << "{\"name\": \"" << name << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << thread
+                << ", \"ts\": " << begin << ", \"dur\": " << duration
+                << ", \"args\": {\"iteration\": " << iteration << "}}";
+    }
+
+    std::ostream& output_;
+    size_t events_;
+};
+
+// Runs k-means iterations from given initial centroids with given assignment
+// step until one of stopping criteria fires, seed drives relocation of empty
+// clusters
+template <class T, class A>
+KMeansResult KMeans(const BasicPoints<T>& data, BasicPoints<A> centroids, AssignmentStep<T, A>* step,
+                    const StoppingCriteria& criteria, uint64_t seed, IterationLog* log = nullptr) {
+    size_t dimensions = data.Dimensions();
+    size_t K = centroids.Size();
+    KMeansResult result;
+    result.clusters.assign(data.Size(), K);
+
+    BasicPoints<A> nextCentroids(K, dimensions);
+    std::vector<size_t> clusters_sizes(K);
+    std::vector<double> movement(K);
+    bool track_inertia = criteria.inertia_change >= 0 || log != nullptr;
+    double previous_inertia = std::numeric_limits<double>::infinity();
+
+    result.assign_time = 0;
+    result.update_time = 0;
+    double run_start_time = omp_get_wtime();
+    size_t iterationNumber = 0;
+    while (true) {
+        double inertia = 0;
+        double start_time = omp_get_wtime();
+        size_t reassigned = step->Assign(centroids, &result.clusters, &nextCentroids,
+                                         &clusters_sizes, track_inertia ? &inertia : nullptr);
+        double assigned_time = omp_get_wtime();
+        UpdateCentroids(centroids, clusters_sizes, seed, iterationNumber, &nextCentroids);
+
+        double max_shift = 0;
+        for (size_t k = 0; k < K; ++k) {
+            movement[k] = Distance(centroids.Row(k), nextCentroids.Row(k), dimensions);
+            max_shift = std::max(max_shift, movement[k]);
+        }
+        double updated_time = omp_get_wtime();
+        step->CentroidsMoved(result.clusters, movement);
+        centroids.Swap(nextCentroids);
+        double end_time = omp_get_wtime();
+        result.assign_time += (assigned_time - start_time) + (end_time - updated_time);
+        result.update_time += updated_time - assigned_time;
+        ++iterationNumber;
+
+        if (log != nullptr) {
+            IterationMetrics metrics;
+            metrics.iteration = iterationNumber;
+            metrics.begin_time = start_time - run_start_time;
+            metrics.assign_time = (assigned_time - start_time) + (end_time - updated_time);
+            metrics.update_time = updated_time - assigned_time;
+            metrics.reassigned = reassigned;
+            metrics.inertia = inertia;
+            metrics.max_shift = max_shift;
+            metrics.empty_clusters = std::count(clusters_sizes.begin(), clusters_sizes.end(), 0);
+            metrics.thread_times = step->ThreadTimes();
+            log->Record(metrics);
+        }
+
+        double inertia_change = std::numeric_limits<double>::infinity();
+        if (track_inertia && iterationNumber > 1) {
+            inertia_change = std::fabs(previous_inertia - inertia) / std::max(inertia, 1e-300);
+        }
+        previous_inertia = inertia;
+        if (ShouldStop(criteria, iterationNumber, static_cast<double>(reassigned) / step->PointsNumber(),
+                       max_shift, inertia_change, &result.stop_reason)) {
+            break;
+        }
+    }
+
+    result.iterations = iterationNumber;
+    result.inertia = Inertia(data, result.clusters, centroids);
+    result.centroids.AssignFrom(centroids);
+    return result;
+}
+
+// Engine "auto" switches from linear scan to k-d tree when there are at
+// least this many clusters per dimension. In more dimensions than
+// kKdTreeMaxDimensions the tree prunes too little to beat vector scan, and
+// from kGemmMinDimensions on GEMM assignment is used instead.
+const size_t kKdTreeClustersPerDimension = 256;
+const size_t kKdTreeMaxDimensions = 12;
+const size_t kGemmMinDimensions = 32;
+
+// Creates assignment step by engine name, returns nullptr for unknown names.
+// With update period above 1 cluster sums are updated incrementally, see
+// ClusterAccumulator.
+template <class T, class A>
+AssignmentStep<T, A>* CreateAssignmentStep(std::string name, const BasicPoints<T>& data, size_t K,
+                                           size_t update_period = 1) {
+    if (name == "auto") {
+        size_t dimensions = data.Dimensions();
+        bool use_tree = dimensions <= kKdTreeMaxDimensions &&
+                        K >= kKdTreeClustersPerDimension * dimensions;
+        name = use_tree ? "kdtree" : (dimensions >= kGemmMinDimensions ? "gemm" : "lloyd");
+    }
+    if (name == "lloyd") {
+        return new LloydStep<T, A>(data, K, update_period);
+    } else if (name == "hamerly") {
+        return new HamerlyStep<T, A>(data, K, update_period);
+    } else if (name == "kdtree") {
+        return new KdTreeStep<T, A>(data, K, update_period);
+    } else if (name == "gemm") {
+        return new GemmStep<T, A>(data, K, update_period);
+    }
+    return nullptr;
+}
+
+/*
+    Mini-batch k-means (Sculley, "Web-scale k-means clustering"): every
+    iteration takes the next batch of points from the stream, assigns them to
+    nearest centroids and moves every centroid towards the mean of its batch
+    points with learning rate equal to the share of this batch among all points
+    the centroid has seen so far. Stream is rewound at the end of file, so only
+    one batch is kept in memory. Batches are taken sequentially rather than
+    sampled, so input should not be sorted. Stops by iterations limit or by
+    centroids shift.
+*/
+inline bool MiniBatchKMeans(PointsStream* stream, size_t K, size_t batch_size, const std::string& init,
+                            uint64_t seed, const StoppingCriteria& criteria, KMeansResult* result) {
+    size_t dimensions = stream->Dimensions();
+    Points batch;
+    if (stream->Read(batch_size, &batch) < K) {
+        if (!stream->Failed()) {
+            std::cerr << "Error: the first batch has fewer points than clusters" << std::endl;
+        }
+        return false;
+    }
+    Points centroids;
+    if (!SeedCentroids(batch, K, init, seed, &centroids)) {
+        return false;
+    }
+
+    LloydStep<double, double> step(batch, K);
+    Points sums(K, dimensions);
+    std::vector<size_t> clusters_sizes(K);
+    std::vector<size_t> clusters;
+    std::vector<double> seen(K);
+
+    size_t iterationNumber = 0;
+    while (true) {
+        clusters.assign(batch.Size(), K);
+        step.Assign(centroids, &clusters, &sums, &clusters_sizes, nullptr);
+
+        double max_shift = 0;
+        for (size_t k = 0; k < K; ++k) {
+            if (clusters_sizes[k] == 0) {
+                continue;
+            }
+            seen[k] += clusters_sizes[k];
+            double learning_rate = clusters_sizes[k] / seen[k];
+            double shift_sqr = 0;
+            for (size_t d = 0; d < dimensions; ++d) {
+                double delta = learning_rate * (sums(k, d) / clusters_sizes[k] - centroids(k, d));
+                centroids(k, d) += delta;
+                shift_sqr += delta * delta;
+            }
+            max_shift = std::max(max_shift, std::sqrt(shift_sqr));
+        }
+        ++iterationNumber;
+
+        if (max_shift <= criteria.max_shift) {
+            result->stop_reason = CENTROIDS_SHIFT;
+            break;
+        }
+        if (iterationNumber >= criteria.max_iterations) {
+            result->stop_reason = MAX_ITERATIONS;
+            break;
+        }
+        if (stream->Read(batch_size, &batch) == 0) {
+            if (stream->Failed() || !stream->Rewind() || stream->Read(batch_size, &batch) == 0) {
+                return false;
+            }
+        }
+    }
+
+    result->iterations = iterationNumber;
+    result->centroids = std::move(centroids);
+    return true;
+}
+
+// Streams all points once, labels them with nearest centroids and writes
+// labels batch by batch, stores sum of squared distances in inertia
+inline bool AssignStream(PointsStream* stream, const Points& centroids, size_t batch_size,
+                         std::ostream& output, double* inertia) {
+    if (!stream->Rewind()) {
+        return false;
+    }
+    size_t K = centroids.Size();
+    Points batch;
+    LloydStep<double, double> step(batch, K);
+    Points sums(K, centroids.Dimensions());
+    std::vector<size_t> clusters_sizes(K);
+    std::vector<size_t> clusters;
+    *inertia = 0;
+    while (stream->Read(batch_size, &batch) != 0) {
+        clusters.assign(batch.Size(), K);
+        double batch_inertia;
+        step.Assign(centroids, &clusters, &sums, &clusters_sizes, &batch_inertia);
+        *inertia += batch_inertia;
+        WriteLabels(clusters, output);
+    }
+    return !stream->Failed();
+}
+
+#endif
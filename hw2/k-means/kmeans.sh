@@ -1,2 +1,3 @@
 #/bin/sh
-/home/kashin/src/cpp/hw2/k-means/generate_report.sh $task
+cd $PBS_O_WORKDIR
+./generate_report.sh $task
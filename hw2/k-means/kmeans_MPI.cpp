@@ -0,0 +1,339 @@
+#include <climits>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <getopt.h>
+
+#include "mpi.h"
+#include "kmeans.h"
+#include "points.h"
+
+using namespace std;
+
+/*
+    Hybrid MPI + OpenMP k-means. Every process owns a contiguous shard of
+    points and runs the usual OpenMP assignment step on it; cluster sums,
+    sizes, reassigned counts and inertia are combined with MPI_Allreduce, so
+    all processes update identical centroids. Labels are written to one file
+    with MPI-IO, each process at the offset of its shard.
+*/
+
+static_assert(sizeof(size_t) == sizeof(unsigned long), "size_t is sent as MPI_UNSIGNED_LONG");
+
+// Returns true on every process when condition holds on all of them
+bool AllSucceeded(bool ok) {
+    int local = ok ? 1 : 0;
+    int global = 0;
+    MPI_Allreduce(&local, &global, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return global != 0;
+}
+
+// Assignment step over the local shard whose results are summed over all
+// processes, so driver sees step over the whole data set
+class DistributedStep : public AssignmentStep<double, double> {
+public:
+    DistributedStep(AssignmentStep<double, double>* local_step, size_t total_points)
+        : local_step_(local_step), total_points_(total_points) {
+    }
+
+    size_t Assign(const Points& centroids, vector<size_t>* clusters, Points* sums,
+                  vector<size_t>* clusters_sizes, double* inertia) {
+        unsigned long reassigned = local_step_->Assign(centroids, clusters, sums, clusters_sizes, inertia);
+        size_t K = centroids.Size();
+        MPI_Allreduce(MPI_IN_PLACE, sums->Row(0), K * centroids.Dimensions(), MPI_DOUBLE, MPI_SUM,
+                      MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, clusters_sizes->data(), K, MPI_UNSIGNED_LONG, MPI_SUM,
+                      MPI_COMM_WORLD);
+        MPI_Allreduce(MPI_IN_PLACE, &reassigned, 1, MPI_UNSIGNED_LONG, MPI_SUM, MPI_COMM_WORLD);
+        if (inertia != nullptr) {
+            MPI_Allreduce(MPI_IN_PLACE, inertia, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        }
+        return reassigned;
+    }
+
+    size_t PointsNumber() const {
+        return total_points_;
+    }
+
+    void CentroidsMoved(const vector<size_t>& clusters, const vector<double>& movement) {
+        local_step_->CentroidsMoved(clusters, movement);
+    }
+
+    vector<double> ThreadTimes() const {
+        return local_step_->ThreadTimes();
+    }
+
+    // Collective, process 0 prints statistics summed over all shards
+    void Report() const {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        unsigned long local = local_step_->DistanceComputations();
+        unsigned long total = 0;
+        MPI_Reduce(&local, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0 && total != 0) {
+            std::cerr << "Distance computations: " << total << std::endl;
+        }
+    }
+
+private:
+    std::unique_ptr<AssignmentStep<double, double> > local_step_;
+    size_t total_points_;
+};
+
+// First point of the shard owned by given rank
+size_t ShardBegin(size_t size, int rank, int ranks) {
+    return size * rank / ranks;
+}
+
+// Maps binary points file on every process and takes rows of own shard,
+// float64 rows are used in place
+bool ReadBinaryShard(const char* path, int rank, int ranks, PointsFile* points_file,
+                     size_t* total_size, Points* shard) {
+    if (!points_file->Open(path)) {
+        return false;
+    }
+    size_t dimensions = points_file->Dimensions();
+    *total_size = points_file->Size();
+    size_t begin = ShardBegin(*total_size, rank, ranks);
+    size_t size = ShardBegin(*total_size, rank + 1, ranks) - begin;
+    if (points_file->Type() == FLOAT64) {
+        *shard = Points::View(static_cast<double*>(points_file->Data()) + begin * dimensions,
+                              size, dimensions);
+        return true;
+    }
+    shard->Assign(size, dimensions);
+    const float* rows = static_cast<const float*>(points_file->Data()) + begin * dimensions;
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < size; ++i) {
+        for (size_t d = 0; d < dimensions; ++d) {
+            (*shard)(i, d) = rows[i * dimensions + d];
+        }
+    }
+    return true;
+}
+
+// Text file is parsed by the root process and scattered by shards
+bool ReadTextShard(const char* path, int rank, int ranks, size_t* total_size, Points* shard) {
+    Points data;
+    uint64_t shape[2] = {0, 0};
+    if (rank == 0 && ReadTextPoints(path, &data, ROW_MAJOR)) {
+        shape[0] = data.Size();
+        shape[1] = data.Dimensions();
+        if (shape[0] * shape[1] > static_cast<uint64_t>(INT_MAX)) {
+            cerr << "Error: text input is too large to scatter, convert it to binary" << endl;
+            shape[0] = 0;
+        }
+    }
+    MPI_Bcast(shape, 2, MPI_UINT64_T, 0, MPI_COMM_WORLD);
+    if (shape[0] == 0) {
+        return false;
+    }
+    *total_size = shape[0];
+    size_t dimensions = shape[1];
+    vector<int> counts(ranks);
+    vector<int> displacements(ranks);
+    for (int r = 0; r < ranks; ++r) {
+        displacements[r] = ShardBegin(shape[0], r, ranks) * dimensions;
+        counts[r] = ShardBegin(shape[0], r + 1, ranks) * dimensions - displacements[r];
+    }
+    shard->Assign(counts[rank] / dimensions, dimensions);
+    MPI_Scatterv(rank == 0 ? data.Row(0) : nullptr, counts.data(), displacements.data(), MPI_DOUBLE,
+                 shard->Row(0), counts[rank], MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    return true;
+}
+
+// Same centroids as InitCentroids on the whole data set: every process draws
+// the same indices and the owner of each point contributes its coordinates
+Points InitDistributedCentroids(const Points& shard, size_t shard_begin, size_t total_size, size_t K) {
+    Points centroids(K, shard.Dimensions());
+    for (size_t k = 0; k < K; ++k) {
+        size_t index = UniformRandom(total_size - 1);
+        if (index >= shard_begin && index < shard_begin + shard.Size()) {
+            shard.CopyPoint(index - shard_begin, centroids.Row(k));
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, centroids.Row(0), K * shard.Dimensions(), MPI_DOUBLE, MPI_SUM,
+                  MPI_COMM_WORLD);
+    return centroids;
+}
+
+// Every process writes its labels at the offset equal to the length of
+// labels text of preceding shards
+bool WriteDistributedLabels(const char* path, const vector<size_t>& clusters) {
+    ostringstream formatted;
+    WriteLabels(clusters, formatted);
+    string labels = formatted.str();
+
+    unsigned long long length = labels.size();
+    unsigned long long offset = 0;
+    unsigned long long total = 0;
+    MPI_Exscan(&length, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&length, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        offset = 0;  // MPI_Exscan leaves it undefined on the first process
+    }
+
+    MPI_File file;
+    if (MPI_File_open(MPI_COMM_WORLD, const_cast<char*>(path), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if (rank == 0) {
+            cerr << "Error: output file could not be opened" << endl;
+        }
+        return false;
+    }
+    MPI_File_set_size(file, total);
+    bool ok = true;
+    const size_t kChunk = 1 << 30;
+    for (size_t written = 0; written < labels.size() && ok; written += kChunk) {
+        int chunk = std::min(kChunk, labels.size() - written);
+        ok = MPI_File_write_at(file, offset + written, const_cast<char*>(labels.data() + written),
+                               chunk, MPI_CHAR, MPI_STATUS_IGNORE) == MPI_SUCCESS;
+    }
+    MPI_File_close(&file);
+    return AllSucceeded(ok);
+}
+
+void PrintUsage(const char* program) {
+    std::printf("Usage: mpirun [-np N] %s [options] number_of_clusters input_file output_file\n",
+                program);
+    std::printf("Binary input is mapped by every process, text input is parsed by rank 0\n");
+    std::printf("and scattered. Centroids are seeded randomly as in kmeans.\n");
+    std::printf("Options:\n");
+    std::printf("  --engine=auto|lloyd|hamerly|kdtree|gemm\n");
+    std::printf("                          clustering algorithm, auto picks kdtree when\n");
+    std::printf("                          D <= 12 and K >= 256 * D, gemm when D >= 32 and\n");
+    std::printf("                          lloyd otherwise (default: auto)\n");
+    std::printf("  --kernel=auto|scalar|avx2|avx512\n");
+    std::printf("                          nearest centroid kernel (default: auto)\n");
+    std::printf("  --seed=N                random seed (default: 123)\n");
+    std::printf("Stopping criteria, negative value disables criterion:\n");
+    std::printf("  --max-iterations=N      iterations limit (default: 100)\n");
+    std::printf("  --tolerance=X           largest centroid shift (default: 0)\n");
+    std::printf("  --reassigned=X          fraction of reassigned points (default: 0)\n");
+    std::printf("  --inertia-tolerance=X   relative inertia change (default: -1)\n");
+}
+
+int Run(int argc, char** argv, int rank, int ranks) {
+    string kernel = "auto";
+    string engine = "auto";
+    StoppingCriteria criteria;
+    uint64_t seed = 123;
+
+    static const struct option long_options[] = {
+        {"engine", required_argument, nullptr, 'e'},
+        {"kernel", required_argument, nullptr, 'k'},
+        {"max-iterations", required_argument, nullptr, 'i'},
+        {"tolerance", required_argument, nullptr, 't'},
+        {"reassigned", required_argument, nullptr, 'r'},
+        {"inertia-tolerance", required_argument, nullptr, 'n'},
+        {"seed", required_argument, nullptr, 'S'},
+        {nullptr, 0, nullptr, 0}
+    };
+    opterr = rank == 0;
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1) {
+        switch (option) {
+            case 'e':
+                engine = optarg;
+                break;
+            case 'k':
+                kernel = optarg;
+                break;
+            case 'i':
+                criteria.max_iterations = atoi(optarg);
+                break;
+            case 't':
+                criteria.max_shift = atof(optarg);
+                break;
+            case 'r':
+                criteria.reassigned_fraction = atof(optarg);
+                break;
+            case 'n':
+                criteria.inertia_change = atof(optarg);
+                break;
+            case 'S':
+                seed = strtoull(optarg, nullptr, 10);
+                break;
+            default:
+                if (rank == 0) {
+                    PrintUsage(argv[0]);
+                }
+                return 1;
+        }
+    }
+    if (argc - optind != 3) {
+        if (rank == 0) {
+            PrintUsage(argv[0]);
+        }
+        return 1;
+    }
+    if (!SelectNearestCentroidKernel(kernel)) {
+        if (rank == 0) {
+            cerr << "Error: kernel " << kernel << " is not supported" << endl;
+        }
+        return 1;
+    }
+    argv += optind;
+    size_t K = atoi(argv[0]);
+    srand(seed); // same random sequence on every process
+
+    char* input_file = argv[1];
+    PointsFile points_file;
+    Points shard;
+    size_t total_size = 0;
+    bool loaded;
+    if (IsBinaryPointsFile(input_file)) {
+        loaded = AllSucceeded(ReadBinaryShard(input_file, rank, ranks, &points_file, &total_size, &shard));
+    } else {
+        loaded = ReadTextShard(input_file, rank, ranks, &total_size, &shard);
+    }
+    if (!loaded) {
+        return 1;
+    }
+    if (total_size < K) {
+        if (rank == 0) {
+            cerr << "Error: number of clusters exceeds number of points" << endl;
+        }
+        return 1;
+    }
+
+    AssignmentStep<double, double>* local_step = CreateAssignmentStep<double, double>(engine, shard, K);
+    if (local_step == nullptr) {
+        if (rank == 0) {
+            cerr << "Error: unknown engine " << engine << endl;
+        }
+        return 1;
+    }
+    DistributedStep step(local_step, total_size);
+    Points centroids = InitDistributedCentroids(shard, ShardBegin(total_size, rank, ranks), total_size, K);
+    KMeansResult result = KMeans(shard, std::move(centroids), &step, criteria, seed);
+    // Final inertia is computed by the driver over the local shard only
+    MPI_Allreduce(MPI_IN_PLACE, &result.inertia, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        std::cerr << "Processes: " << ranks << ", threads per process: " << omp_get_max_threads()
+                  << std::endl;
+        std::cerr << "Iterations: " << result.iterations << std::endl;
+        std::cerr << "Stopped by: " << StopReasonName(result.stop_reason) << std::endl;
+        std::cerr << "Inertia: " << result.inertia << std::endl;
+    }
+    step.Report();
+
+    return WriteDistributedLabels(argv[2], result.clusters) ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    int rank, ranks;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+    int status = Run(argc, argv, rank, ranks);
+    MPI_Finalize();
+    return status;
+}
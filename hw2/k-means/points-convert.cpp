@@ -0,0 +1,106 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+#include "points.h"
+
+using namespace std;
+
+bool ParseType(const string& name, PointsType* type) {
+    if (name == "float32") {
+        *type = FLOAT32;
+    } else if (name == "float64") {
+        *type = FLOAT64;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// True if both paths name the same existing file
+bool SameFile(const char* first, const char* second) {
+    struct stat first_stat, second_stat;
+    return stat(first, &first_stat) == 0 && stat(second, &second_stat) == 0 &&
+           first_stat.st_dev == second_stat.st_dev && first_stat.st_ino == second_stat.st_ino;
+}
+
+void WriteBinary(const Points& data, PointsType type, ofstream& output) {
+    WritePointsHeader(output, data.Size(), data.Dimensions(), type);
+    WriteBinaryPoints(output, data, type);
+}
+
+void WriteText(const PointsFile& file, ofstream& output) {
+    size_t dimensions = file.Dimensions();
+    // Enough digits to read back exactly the same binary value
+    output << setprecision(file.Type() == FLOAT64 ? 17 : 9);
+    output << file.Size() << " " << dimensions << "\n";
+    for (size_t i = 0; i < file.Size(); ++i) {
+        for (size_t d = 0; d < dimensions; ++d) {
+            if (file.Type() == FLOAT64) {
+                output << static_cast<const double*>(file.Data())[i * dimensions + d];
+            } else {
+                output << static_cast<const float*>(file.Data())[i * dimensions + d];
+            }
+            output << (d + 1 == dimensions ? "\n" : " ");
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4) {
+        cerr << "Usage: " << argv[0] << " input_file output_file [float32|float64]" << endl;
+        cerr << "Converts text points file to binary one (float64 by default) and back" << endl;
+        return 1;
+    }
+    char* input_file = argv[1];
+    char* output_file = argv[2];
+    if (string(input_file) == output_file || SameFile(input_file, output_file)) {
+        cerr << "Error: input and output files must differ" << endl;
+        return 1;
+    }
+
+    // Input is read and checked before output is opened, so a bad input
+    // never truncates the output file
+    bool binary_input = IsBinaryPointsFile(input_file);
+    PointsType type = FLOAT64;
+    PointsFile file;
+    Points data;
+    if (binary_input) {
+        if (argc == 4) {
+            cerr << "Error: binary file can only be converted to text" << endl;
+            return 1;
+        }
+        if (!file.Open(input_file)) {
+            return 1;
+        }
+    } else {
+        if (argc == 4 && !ParseType(argv[3], &type)) {
+            cerr << "Error: unknown coordinate type " << argv[3] << endl;
+            return 1;
+        }
+        if (!ReadTextPoints(input_file, &data, ROW_MAJOR)) {
+            return 1;
+        }
+    }
+
+    ofstream output(output_file, ofstream::binary);
+    if (!output) {
+        cerr << "Error: output file could not be opened" << endl;
+        return 1;
+    }
+    if (binary_input) {
+        WriteText(file, output);
+    } else {
+        WriteBinary(data, type, output);
+    }
+
+    output.close();
+    if (!output) {
+        cerr << "Error: failed to write output file" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "omp.h"
+#include "points.h"
+
+using namespace std;
+
+/*
+    Checks that parallel ReadTextPoints gives the same matrix as the
+    sequential one. The file has runs of mixed whitespace of varying length,
+    so with every threads number some chunks end in whitespace and some in
+    the middle of a number.
+*/
+
+const size_t kSize = 20000;
+const size_t kDimensions = 3;
+
+double Coordinate(size_t i, size_t d) {
+    return static_cast<double>(i * 7 + d * 13 % 101) / 8 - 1000;
+}
+
+void WriteTestFile(const char* path) {
+    const char* separators[] = {" ", "\t", "  \n", "\n\n", " \t \r\n"};
+    ofstream output(path);
+    output << setprecision(17);
+    output << kSize << " " << kDimensions << "\n";
+    for (size_t i = 0; i < kSize; ++i) {
+        for (size_t d = 0; d < kDimensions; ++d) {
+            output << Coordinate(i, d) << separators[(i * kDimensions + d) % 5];
+        }
+    }
+    output << "   \n";
+}
+
+bool ReadWithThreads(const char* path, int threads, Points* data) {
+    omp_set_num_threads(threads);
+    return ReadTextPoints(path, data, ROW_MAJOR);
+}
+
+int main() {
+    string path = "/tmp/points-test-" + to_string(getpid()) + ".txt";
+    WriteTestFile(path.c_str());
+
+    bool ok = true;
+    Points expected;
+    if (!ReadWithThreads(path.c_str(), 1, &expected)) {
+        ok = false;
+    }
+    for (size_t i = 0; i < expected.Size() && ok; ++i) {
+        for (size_t d = 0; d < kDimensions; ++d) {
+            if (expected(i, d) != Coordinate(i, d)) {
+                cerr << "Error: 1 thread read point " << i << " wrong" << endl;
+                ok = false;
+                break;
+            }
+        }
+    }
+    for (int threads = 2; threads <= 16 && ok; ++threads) {
+        Points data;
+        if (!ReadWithThreads(path.c_str(), threads, &data)) {
+            ok = false;
+            break;
+        }
+        for (size_t i = 0; i < kSize && ok; ++i) {
+            for (size_t d = 0; d < kDimensions; ++d) {
+                if (data(i, d) != expected(i, d)) {
+                    cerr << "Error: " << threads << " threads read point " << i
+                         << " differently from 1 thread" << endl;
+                    ok = false;
+                    break;
+                }
+            }
+        }
+    }
+    remove(path.c_str());
+    cout << (ok ? "OK" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,878 @@
+#ifndef POINTS_H
+#define POINTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "omp.h"
+
+enum PointsLayout {
+    ROW_MAJOR,    // point coordinates are contiguous (array of structures)
+    COLUMN_MAJOR  // each coordinate is contiguous across points (structure of arrays)
+};
+
+// Dense size x dimensions matrix of coordinates kept in one aligned buffer.
+// Element (i, d) lives at i * point_stride + d * dimension_stride, so both
+// layouts share the same accessors. Columns of COLUMN_MAJOR matrix are padded
+// to a cache line so every coordinate array starts aligned. Coordinate type T
+// is double or float.
+template <class T>
+class BasicPoints {
+public:
+    static const size_t kAlignment = 64;
+
+    BasicPoints()
+        : size_(0), dimensions_(0), layout_(ROW_MAJOR),
+          point_stride_(0), dimension_stride_(0), capacity_(0), data_(nullptr), owned_(true) {
+    }
+
+    BasicPoints(size_t size, size_t dimensions, PointsLayout layout = ROW_MAJOR)
+        : BasicPoints() {
+        Assign(size, dimensions, layout);
+    }
+
+    BasicPoints(const BasicPoints& other) : BasicPoints() {
+        *this = other;
+    }
+
+    BasicPoints(BasicPoints&& other) : BasicPoints() {
+        Swap(other);
+    }
+
+    ~BasicPoints() {
+        Release();
+    }
+
+    // Wraps external ROW_MAJOR buffer without copying, buffer must outlive
+    // the matrix. Assign reallocates matrix into its own storage.
+    static BasicPoints View(T* data, size_t size, size_t dimensions) {
+        BasicPoints view;
+        view.size_ = size;
+        view.dimensions_ = dimensions;
+        view.point_stride_ = dimensions;
+        view.dimension_stride_ = 1;
+        view.capacity_ = size * dimensions;
+        view.data_ = data;
+        view.owned_ = false;
+        return view;
+    }
+
+    BasicPoints& operator=(const BasicPoints& other) {
+        if (this != &other) {
+            Assign(other.size_, other.dimensions_, other.layout_);
+            memcpy(data_, other.data_, capacity_ * sizeof(T));
+        }
+        return *this;
+    }
+
+    BasicPoints& operator=(BasicPoints&& other) {
+        Swap(other);
+        return *this;
+    }
+
+    void Swap(BasicPoints& other) {
+        std::swap(size_, other.size_);
+        std::swap(dimensions_, other.dimensions_);
+        std::swap(layout_, other.layout_);
+        std::swap(point_stride_, other.point_stride_);
+        std::swap(dimension_stride_, other.dimension_stride_);
+        std::swap(capacity_, other.capacity_);
+        std::swap(data_, other.data_);
+        std::swap(owned_, other.owned_);
+    }
+
+    // Reallocates storage for size x dimensions zero-initialized matrix
+    void Assign(size_t size, size_t dimensions, PointsLayout layout = ROW_MAJOR) {
+        size_t capacity;
+        if (layout == ROW_MAJOR) {
+            point_stride_ = dimensions;
+            dimension_stride_ = 1;
+            capacity = size * dimensions;
+        } else {
+            size_t values_per_line = kAlignment / sizeof(T);
+            point_stride_ = 1;
+            dimension_stride_ = (size + values_per_line - 1) / values_per_line * values_per_line;
+            capacity = dimension_stride_ * dimensions;
+        }
+        if (capacity != capacity_ || !owned_) {
+            Release();
+            if (capacity != 0 && posix_memalign(reinterpret_cast<void**>(&data_),
+                                                kAlignment, capacity * sizeof(T)) != 0) {
+                throw std::bad_alloc();
+            }
+            capacity_ = capacity;
+        }
+        size_ = size;
+        dimensions_ = dimensions;
+        layout_ = layout;
+        FirstTouch();
+    }
+
+    // Copies matrix of another coordinate type keeping its layout
+    template <class U>
+    void AssignFrom(const BasicPoints<U>& other) {
+        Assign(other.Size(), other.Dimensions(), other.Layout());
+        #pragma omp parallel for schedule(static) if (IsLarge())
+        for (size_t i = 0; i < size_; ++i) {
+            for (size_t d = 0; d < dimensions_; ++d) {
+                (*this)(i, d) = static_cast<T>(other(i, d));
+            }
+        }
+    }
+
+    void Fill(T value) {
+        std::fill(data_, data_ + capacity_, value);
+    }
+
+    size_t Size() const { return size_; }
+    size_t Dimensions() const { return dimensions_; }
+    PointsLayout Layout() const { return layout_; }
+
+    T& operator()(size_t i, size_t d) {
+        return data_[i * point_stride_ + d * dimension_stride_];
+    }
+
+    T operator()(size_t i, size_t d) const {
+        return data_[i * point_stride_ + d * dimension_stride_];
+    }
+
+    // Pointer to contiguous coordinates of i-th point, ROW_MAJOR only
+    T* Row(size_t i) {
+        return data_ + i * point_stride_;
+    }
+
+    const T* Row(size_t i) const {
+        return data_ + i * point_stride_;
+    }
+
+    // Gathers coordinates of i-th point into contiguous buffer
+    void CopyPoint(size_t i, T* point) const {
+        const T* source = data_ + i * point_stride_;
+        for (size_t d = 0; d < dimensions_; ++d) {
+            point[d] = source[d * dimension_stride_];
+        }
+    }
+
+    // Returns pointer to contiguous coordinates of i-th point, using buffer
+    // as scratch space when points are not stored contiguously
+    const T* GetPoint(size_t i, T* buffer) const {
+        if (layout_ == ROW_MAJOR) {
+            return Row(i);
+        }
+        CopyPoint(i, buffer);
+        return buffer;
+    }
+
+private:
+    // Matrices from this many values are zeroed and converted in parallel
+    static const size_t kParallelValues = 1 << 15;
+
+    bool IsLarge() const {
+        return size_ * dimensions_ >= kParallelValues && !omp_in_parallel();
+    }
+
+    // Zeroes the matrix with the static schedule over points which assignment
+    // loops use, so on NUMA machines pages holding points of every thread are
+    // first touched, and therefore placed, on the socket of that thread
+    void FirstTouch() {
+        #pragma omp parallel for schedule(static) if (IsLarge())
+        for (size_t i = 0; i < size_; ++i) {
+            for (size_t d = 0; d < dimensions_; ++d) {
+                (*this)(i, d) = 0;
+            }
+        }
+        // Column padding of COLUMN_MAJOR matrix
+        for (size_t d = 0; d < dimensions_ && layout_ == COLUMN_MAJOR; ++d) {
+            std::fill(data_ + d * dimension_stride_ + size_, data_ + (d + 1) * dimension_stride_, T(0));
+        }
+    }
+
+    void Release() {
+        if (owned_) {
+            free(data_);
+        }
+        data_ = nullptr;
+        capacity_ = 0;
+        owned_ = true;
+    }
+
+    size_t size_;
+    size_t dimensions_;
+    PointsLayout layout_;
+    size_t point_stride_;
+    size_t dimension_stride_;
+    size_t capacity_;
+    T* data_;
+    bool owned_;
+};
+
+typedef BasicPoints<double> Points;
+typedef BasicPoints<float> FloatPoints;
+
+// Private memory mapping of the whole file
+class MappedFile {
+public:
+    MappedFile() : data_(nullptr), length_(0) {
+    }
+
+    ~MappedFile() {
+        if (data_ != nullptr) {
+            munmap(data_, length_);
+        }
+    }
+
+    // Prints error and returns false on failure. Mapping is writable copy on
+    // write, so pages are copied only if somebody writes to them.
+    bool Open(const char* path) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            std::cerr << "Error: input file could not be opened" << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            std::cerr << "Error: input file could not be opened" << std::endl;
+            close(fd);
+            return false;
+        }
+        length_ = info.st_size;
+        if (length_ == 0) {
+            close(fd);
+            return true;
+        }
+        void* mapping = mmap(nullptr, length_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cerr << "Error: input file could not be mapped" << std::endl;
+            length_ = 0;
+            return false;
+        }
+        data_ = static_cast<char*>(mapping);
+        madvise(data_, length_, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    char* Data() const { return data_; }
+    size_t Length() const { return length_; }
+
+private:
+    char* data_;
+    size_t length_;
+};
+
+inline bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Parses decimal number occupying the whole [begin, end) range. Numbers with
+// at most 15 significant digits and small exponent take exact fast path:
+// both mantissa and power of ten are exact doubles, so single multiplication
+// or division is correctly rounded. Anything else is handed to strtod, so
+// result is always the same as of strtod.
+inline bool ParseDouble(const char* begin, const char* end, double* value) {
+    static const double kPowersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* p = begin;
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        ++p;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    while (p != end && *p >= '0' && *p <= '9') {
+        if (mantissa != 0 || *p != '0') {
+            ++digits;
+        }
+        mantissa = mantissa * 10 + (*p - '0');
+        any_digit = true;
+        ++p;
+        if (digits > 15) {
+            break;
+        }
+    }
+    if (p != end && *p == '.' && digits <= 15) {
+        ++p;
+        while (p != end && *p >= '0' && *p <= '9' && digits <= 15) {
+            if (mantissa != 0 || *p != '0') {
+                ++digits;
+            }
+            mantissa = mantissa * 10 + (*p - '0');
+            --exponent;
+            any_digit = true;
+            ++p;
+        }
+    }
+    if (p != end && (*p == 'e' || *p == 'E') && digits <= 15 && any_digit) {
+        ++p;
+        bool negative_exponent = false;
+        if (p != end && (*p == '-' || *p == '+')) {
+            negative_exponent = (*p == '-');
+            ++p;
+        }
+        int explicit_exponent = 0;
+        bool exponent_digit = false;
+        while (p != end && *p >= '0' && *p <= '9' && explicit_exponent < 10000) {
+            explicit_exponent = explicit_exponent * 10 + (*p - '0');
+            exponent_digit = true;
+            ++p;
+        }
+        if (!exponent_digit) {
+            any_digit = false;
+        }
+        exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+    }
+    if (p == end && any_digit && digits <= 15 && exponent >= -22 && exponent <= 22) {
+        double result = static_cast<double>(mantissa);
+        result = (exponent < 0) ? result / kPowersOfTen[-exponent] : result * kPowersOfTen[exponent];
+        *value = negative ? -result : result;
+        return true;
+    }
+
+    char buffer[128];
+    size_t length = end - begin;
+    if (length >= sizeof(buffer)) {
+        return false;
+    }
+    memcpy(buffer, begin, length);
+    buffer[length] = 0;
+    char* parsed_end;
+    *value = strtod(buffer, &parsed_end);
+    return parsed_end == buffer + length;
+}
+
+// True if header value is a finite non-negative integer which fits size_t
+inline bool IsPointsCount(double value) {
+    return value >= 0 && value < 18446744073709551616.0 && value == floor(value);
+}
+
+// Prints error and returns false if size x dimensions matrix of doubles
+// would not fit address space
+inline bool CheckPointsShape(uint64_t size, uint64_t dimensions) {
+    if (dimensions != 0 && size > SIZE_MAX / sizeof(double) / dimensions) {
+        std::cerr << "Error: points file is too large, " << size << " x " << dimensions
+                  << " coordinates" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/*
+    Reads text points file: "size dimensions" followed by size * dimensions
+    coordinates separated by any whitespace. File is mapped and split into one
+    chunk per thread at whitespace boundaries. Threads count numbers in their
+    chunks, prefix sums give index of the first coordinate of every chunk, and
+    then threads parse their chunks straight into the final matrix.
+    Prints error and returns false on malformed input.
+*/
+template <class T>
+bool ReadTextPoints(const char* path, BasicPoints<T>* data, PointsLayout layout) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return false;
+    }
+    const char* text = file.Data();
+    const char* text_end = text + file.Length();
+
+    size_t header[2];
+    const char* p = text;
+    for (size_t h = 0; h < 2; ++h) {
+        while (p != text_end && IsSpace(*p)) {
+            ++p;
+        }
+        const char* token = p;
+        while (p != text_end && !IsSpace(*p)) {
+            ++p;
+        }
+        double value;
+        if (token == p || !ParseDouble(token, p, &value) || !IsPointsCount(value)) {
+            std::cerr << "Error: malformed points file header" << std::endl;
+            return false;
+        }
+        header[h] = static_cast<size_t>(value);
+    }
+    size_t data_size = header[0];
+    size_t dimensions = header[1];
+    if (!CheckPointsShape(data_size, dimensions)) {
+        return false;
+    }
+    size_t total = data_size * dimensions;
+    data->Assign(data_size, dimensions, layout);
+
+    size_t chunks = omp_get_max_threads();
+    size_t body_length = text_end - p;
+    std::vector<const char*> bounds(chunks + 1);
+    std::vector<size_t> offsets(chunks + 1);
+    bool ok = true;
+    #pragma omp parallel num_threads(chunks)
+    {
+        size_t chunk = omp_get_thread_num();
+        // Chunk owns every number which starts inside its byte range
+        const char* begin = p + body_length * chunk / chunks;
+        const char* end = p + body_length * (chunk + 1) / chunks;
+        while (begin != p && begin != text_end && !IsSpace(begin[-1])) {
+            ++begin;
+        }
+        while (end != p && end != text_end && !IsSpace(end[-1])) {
+            ++end;
+        }
+        bounds[chunk] = begin;
+        if (chunk + 1 == chunks) {
+            bounds[chunks] = text_end;
+        }
+
+        size_t count = 0;
+        bool in_space = true;
+        for (const char* c = begin; c < end; ++c) {
+            bool space = IsSpace(*c);
+            count += (in_space && !space);
+            in_space = space;
+        }
+        offsets[chunk + 1] = count;
+
+        #pragma omp barrier
+        #pragma omp single
+        {
+            for (size_t i = 0; i < chunks; ++i) {
+                offsets[i + 1] += offsets[i];
+            }
+            if (offsets[chunks] != total) {
+                std::cerr << "Error: expected " << total << " coordinates, found "
+                          << offsets[chunks] << std::endl;
+                ok = false;
+            }
+        }
+
+        if (ok) {
+            const char* c = bounds[chunk];
+            end = std::max(bounds[chunk + 1], c);
+            size_t index = offsets[chunk];
+            while (c < end) {
+                while (c < end && IsSpace(*c)) {
+                    ++c;
+                }
+                // Token may end past the chunk only if it starts inside it
+                if (c == end) {
+                    break;
+                }
+                const char* token = c;
+                while (c != text_end && !IsSpace(*c)) {
+                    ++c;
+                }
+                double value;
+                if (!ParseDouble(token, c, &value)) {
+                    #pragma omp critical
+                    {
+                        std::cerr << "Error: malformed coordinate " << std::string(token, c) << std::endl;
+                        ok = false;
+                    }
+                    break;
+                }
+                (*data)(index / dimensions, index % dimensions) = static_cast<T>(value);
+                ++index;
+            }
+        }
+    }
+    return ok;
+}
+
+/*
+    Binary points file: 64-byte header followed by size x dimensions row-major
+    matrix of float32 or float64 coordinates in native byte order. Header size
+    keeps the matrix aligned, so float64 files are used in place after mmap.
+*/
+enum PointsType {
+    FLOAT32 = 4,
+    FLOAT64 = 8
+};
+
+struct PointsFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t type;  // bytes per coordinate, see PointsType
+    uint64_t size;
+    uint64_t dimensions;
+    char reserved[32];
+};
+
+static_assert(sizeof(PointsFileHeader) == 64, "points file header must be 64 bytes");
+
+const char kPointsFileMagic[8] = {'K', 'M', 'P', 'O', 'I', 'N', 'T', 'S'};
+const uint32_t kPointsFileVersion = 1;
+
+inline bool WritePointsHeader(std::ostream& output, size_t size, size_t dimensions, PointsType type) {
+    PointsFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kPointsFileMagic, sizeof(header.magic));
+    header.version = kPointsFileVersion;
+    header.type = type;
+    header.size = size;
+    header.dimensions = dimensions;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    return static_cast<bool>(output);
+}
+
+// Writes one point in given coordinate type
+inline void WriteBinaryPoint(std::ostream& output, const double* point, size_t dimensions, PointsType type) {
+    if (type == FLOAT64) {
+        output.write(reinterpret_cast<const char*>(point), dimensions * sizeof(double));
+    } else {
+        std::vector<float> coords(point, point + dimensions);
+        output.write(reinterpret_cast<const char*>(coords.data()), dimensions * sizeof(float));
+    }
+}
+
+// Writes ROW_MAJOR matrix of points in given coordinate type
+inline void WriteBinaryPoints(std::ostream& output, const Points& data, PointsType type) {
+    size_t values = data.Size() * data.Dimensions();
+    if (values == 0) {
+        return;
+    }
+    if (type == FLOAT64) {
+        output.write(reinterpret_cast<const char*>(data.Row(0)), values * sizeof(double));
+    } else {
+        std::vector<float> coords(data.Row(0), data.Row(0) + values);
+        output.write(reinterpret_cast<const char*>(coords.data()), values * sizeof(float));
+    }
+}
+
+// Prints error and returns false if header describes unsupported file
+inline bool CheckPointsHeader(const PointsFileHeader& header) {
+    if (memcmp(header.magic, kPointsFileMagic, sizeof(kPointsFileMagic)) != 0 ||
+        header.version != kPointsFileVersion ||
+        (header.type != FLOAT32 && header.type != FLOAT64)) {
+        std::cerr << "Error: unsupported points file format" << std::endl;
+        return false;
+    }
+    return CheckPointsShape(header.size, header.dimensions);
+}
+
+inline bool IsBinaryPointsFile(const char* path) {
+    std::ifstream input(path, std::ifstream::binary);
+    char magic[sizeof(kPointsFileMagic)];
+    return input.read(magic, sizeof(magic)) &&
+           memcmp(magic, kPointsFileMagic, sizeof(magic)) == 0;
+}
+
+// Read-only private mapping of binary points file
+class PointsFile {
+public:
+    PointsFile() : header_(nullptr) {
+    }
+
+    // Maps file and validates header, prints error and returns false on failure
+    bool Open(const char* path) {
+        if (!file_.Open(path)) {
+            return false;
+        }
+        if (file_.Length() < sizeof(PointsFileHeader)) {
+            std::cerr << "Error: points file is truncated" << std::endl;
+            return false;
+        }
+        header_ = reinterpret_cast<const PointsFileHeader*>(file_.Data());
+        if (!CheckPointsHeader(*header_)) {
+            return false;
+        }
+        size_t matrix_length = file_.Length() - sizeof(PointsFileHeader);
+        if (matrix_length / header_->type / std::max<uint64_t>(header_->dimensions, 1) < header_->size) {
+            std::cerr << "Error: points file is truncated" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    size_t Size() const { return header_->size; }
+    size_t Dimensions() const { return header_->dimensions; }
+    PointsType Type() const { return static_cast<PointsType>(header_->type); }
+
+    void* Data() const {
+        return file_.Data() + sizeof(PointsFileHeader);
+    }
+
+    // Returns points viewing the mapping in place when layout and coordinate
+    // type allow it, otherwise converts them into newly allocated matrix.
+    // Copy forces the new matrix, whose pages are first touched by the threads
+    // which assign its points, instead of page cache placed by the kernel.
+    template <class T>
+    BasicPoints<T> Load(PointsLayout layout, bool copy = false) const {
+        size_t size = Size();
+        size_t dimensions = Dimensions();
+        if (Type() == sizeof(T) && layout == ROW_MAJOR && !copy) {
+            return BasicPoints<T>::View(static_cast<T*>(Data()), size, dimensions);
+        }
+        BasicPoints<T> data(size, dimensions, layout);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < size; ++i) {
+            for (size_t d = 0; d < dimensions; ++d) {
+                if (Type() == FLOAT64) {
+                    data(i, d) = static_cast<T>(static_cast<const double*>(Data())[i * dimensions + d]);
+                } else {
+                    data(i, d) = static_cast<T>(static_cast<const float*>(Data())[i * dimensions + d]);
+                }
+            }
+        }
+        return data;
+    }
+
+private:
+    MappedFile file_;
+    const PointsFileHeader* header_;
+};
+
+// Sequential reader of text or binary points file which keeps only a small
+// buffer and one batch of points in memory
+class PointsStream {
+public:
+    static const size_t kBufferSize = 1 << 20;
+
+    PointsStream()
+        : binary_(false), type_(FLOAT64), size_(0), dimensions_(0), remaining_(0),
+          buffer_begin_(0), buffer_end_(0), failed_(false) {
+    }
+
+    // Opens file and reads its header, prints error and returns false on failure
+    bool Open(const char* path) {
+        path_ = path;
+        binary_ = IsBinaryPointsFile(path);
+        return Rewind();
+    }
+
+    // Restarts reading from the first point
+    bool Rewind() {
+        input_.close();
+        input_.clear();
+        input_.open(path_.c_str(), std::ifstream::binary);
+        if (!input_) {
+            std::cerr << "Error: input file could not be opened" << std::endl;
+            return Fail();
+        }
+        buffer_begin_ = buffer_end_ = 0;
+        if (binary_) {
+            PointsFileHeader header;
+            if (!input_.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+                !CheckPointsHeader(header)) {
+                return Fail();
+            }
+            type_ = static_cast<PointsType>(header.type);
+            size_ = header.size;
+            dimensions_ = header.dimensions;
+        } else {
+            double header[2];
+            for (size_t h = 0; h < 2; ++h) {
+                if (!NextNumber(&header[h]) || !IsPointsCount(header[h])) {
+                    std::cerr << "Error: malformed points file header" << std::endl;
+                    return Fail();
+                }
+            }
+            size_ = static_cast<size_t>(header[0]);
+            dimensions_ = static_cast<size_t>(header[1]);
+            if (!CheckPointsShape(size_, dimensions_)) {
+                return Fail();
+            }
+        }
+        remaining_ = size_;
+        return true;
+    }
+
+    size_t Size() const { return size_; }
+    size_t Dimensions() const { return dimensions_; }
+    bool Failed() const { return failed_; }
+
+    // Reads up to count next points into ROW_MAJOR batch and returns number of
+    // points read, which is zero at the end of file or after error
+    size_t Read(size_t count, Points* batch) {
+        if (failed_) {
+            return 0;
+        }
+        count = std::min(count, remaining_);
+        batch->Assign(count, dimensions_, ROW_MAJOR);
+        size_t values = count * dimensions_;
+        if (binary_) {
+            if (type_ == FLOAT64) {
+                input_.read(reinterpret_cast<char*>(batch->Row(0)), values * sizeof(double));
+            } else {
+                std::vector<float> coords(values);
+                input_.read(reinterpret_cast<char*>(coords.data()), values * sizeof(float));
+                std::copy(coords.begin(), coords.end(), batch->Row(0));
+            }
+            if (!input_) {
+                std::cerr << "Error: points file is truncated" << std::endl;
+                Fail();
+                return 0;
+            }
+        } else {
+            double* coords = batch->Row(0);
+            for (size_t v = 0; v < values; ++v) {
+                if (!NextNumber(&coords[v])) {
+                    std::cerr << "Error: points file ended after " << size_ - remaining_ + v / dimensions_
+                              << " points" << std::endl;
+                    Fail();
+                    return 0;
+                }
+            }
+        }
+        remaining_ -= count;
+        return count;
+    }
+
+private:
+    bool Fail() {
+        failed_ = true;
+        return false;
+    }
+
+    // Reads next whitespace separated number of text file
+    bool NextNumber(double* value) {
+        while (true) {
+            while (buffer_begin_ < buffer_end_ && IsSpace(buffer_[buffer_begin_])) {
+                ++buffer_begin_;
+            }
+            size_t token_end = buffer_begin_;
+            while (token_end < buffer_end_ && !IsSpace(buffer_[token_end])) {
+                ++token_end;
+            }
+            bool at_eof = input_.eof();
+            if (token_end < buffer_end_ || (at_eof && token_end > buffer_begin_)) {
+                const char* token = buffer_.data() + buffer_begin_;
+                const char* token_finish = buffer_.data() + token_end;
+                buffer_begin_ = token_end;
+                if (!ParseDouble(token, token_finish, value)) {
+                    std::cerr << "Error: malformed coordinate "
+                              << std::string(token, token_finish) << std::endl;
+                    return false;
+                }
+                return true;
+            }
+            if (at_eof) {
+                return false;
+            }
+            // Token may continue in the next block: move its beginning to the
+            // front of buffer and append more of the file
+            size_t kept = buffer_end_ - buffer_begin_;
+            buffer_.resize(std::max(buffer_.size(), kept + kBufferSize));
+            memmove(buffer_.data(), buffer_.data() + buffer_begin_, kept);
+            input_.read(buffer_.data() + kept, buffer_.size() - kept);
+            buffer_begin_ = 0;
+            buffer_end_ = kept + input_.gcount();
+        }
+    }
+
+    std::string path_;
+    std::ifstream input_;
+    bool binary_;
+    PointsType type_;
+    size_t size_;
+    size_t dimensions_;
+    size_t remaining_;
+    std::vector<char> buffer_;
+    size_t buffer_begin_;
+    size_t buffer_end_;
+    bool failed_;
+};
+
+// Reads whitespace separated non-negative integer labels, such as written by
+// WriteLabels. Prints error and returns false on malformed input.
+inline bool ReadLabels(const char* path, std::vector<size_t>* labels) {
+    MappedFile file;
+    if (!file.Open(path)) {
+        return false;
+    }
+    labels->clear();
+    const char* c = file.Data();
+    const char* end = c + file.Length();
+    while (c != end) {
+        if (IsSpace(*c)) {
+            ++c;
+            continue;
+        }
+        size_t value = 0;
+        const char* token = c;
+        while (c != end && *c >= '0' && *c <= '9') {
+            value = value * 10 + (*c - '0');
+            ++c;
+        }
+        if (c == token || (c != end && !IsSpace(*c))) {
+            std::cerr << "Error: malformed label in " << path << std::endl;
+            return false;
+        }
+        labels->push_back(value);
+    }
+    return true;
+}
+
+// Writes cluster labels one per line. Labels are formatted in parallel, one
+// buffer per thread, and buffers are written in order
+inline void WriteLabels(const std::vector<size_t>& clusters, std::ostream& output) {
+    size_t threads = omp_get_max_threads();
+    std::vector<std::string> buffers(threads);
+    #pragma omp parallel num_threads(threads)
+    {
+        size_t thread = omp_get_thread_num();
+        size_t begin = clusters.size() * thread / threads;
+        size_t end = clusters.size() * (thread + 1) / threads;
+        std::string& buffer = buffers[thread];
+        buffer.reserve((end - begin) * 4);
+        char label[24];
+        for (size_t i = begin; i < end; ++i) {
+            char* p = label + sizeof(label);
+            *--p = '\n';
+            size_t value = clusters[i];
+            do {
+                *--p = '0' + value % 10;
+                value /= 10;
+            } while (value != 0);
+            buffer.append(p, label + sizeof(label));
+        }
+    }
+    for (size_t thread = 0; thread < threads; ++thread) {
+        output.write(buffers[thread].data(), buffers[thread].size());
+    }
+}
+
+// Writes points one per line with coordinates separated by spaces, formatted
+// as %g like std::ostream does by default. Lines are formatted in parallel
+// like labels.
+inline void WriteTextPoints(const Points& data, std::ostream& output) {
+    size_t threads = omp_get_max_threads();
+    size_t dimensions = data.Dimensions();
+    std::vector<std::string> buffers(threads);
+    #pragma omp parallel num_threads(threads)
+    {
+        size_t thread = omp_get_thread_num();
+        size_t begin = data.Size() * thread / threads;
+        size_t end = data.Size() * (thread + 1) / threads;
+        std::string& buffer = buffers[thread];
+        buffer.reserve((end - begin) * dimensions * 9);
+        char coordinate[32];
+        for (size_t i = begin; i < end; ++i) {
+            for (size_t d = 0; d < dimensions; ++d) {
+                int length = snprintf(coordinate, sizeof(coordinate), "%g", data(i, d));
+                buffer.append(coordinate, length);
+                buffer.push_back(d + 1 == dimensions ? '\n' : ' ');
+            }
+        }
+    }
+    for (size_t thread = 0; thread < threads; ++thread) {
+        output.write(buffers[thread].data(), buffers[thread].size());
+    }
+}
+
+#endif
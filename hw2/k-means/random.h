@@ -0,0 +1,22 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+// Counter-based random numbers: value depends only on seed, stream and index,
+// so parallel sampling gives the same result for any number of threads
+inline uint64_t HashRandom(uint64_t seed, uint64_t stream, uint64_t index) {
+    // splitmix64 finalizer applied to combined counter
+    uint64_t x = seed * 0x9E3779B97F4A7C15ULL + stream * 0xBF58476D1CE4E5B9ULL + index;
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Uniform random number in [0, 1)
+inline double HashUniform01(uint64_t seed, uint64_t stream, uint64_t index) {
+    return (HashRandom(seed, stream, index) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
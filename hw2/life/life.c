@@ -6,23 +6,48 @@
 #define ALIVE 'X'
 #define DEAD '.'
 
+/*
+    Grid is padded with halo: one extra row above and below and one extra
+    column on both sides, which hold the wrapped around neighbours of the
+    torus. Halo is refreshed once per generation, so the update reads all 8
+    neighbours at fixed offsets without branches and is vectorized over rows.
+*/
+
+// Position of cell (row, col), -1 <= row, col <= N, in padded grid
 int toindex(int row, int col, int N) {
-    if (row < 0) {
-        row = row + N;
-    } else if (row >= N) {
-        row = row - N;
+    return (row + 1) * (N + 2) + col + 1;
+}
+
+void fillhalo(char* grid, int N) {
+    memcpy(grid + toindex(-1, 0, N), grid + toindex(N - 1, 0, N), N);
+    memcpy(grid + toindex(N, 0, N), grid + toindex(0, 0, N), N);
+    for (int i = -1; i <= N; ++i) {
+        int wrapped = i < 0 ? N - 1 : (i == N ? 0 : i);
+        grid[toindex(i, -1, N)] = grid[toindex(wrapped, N - 1, N)];
+        grid[toindex(i, N, N)] = grid[toindex(wrapped, 0, N)];
     }
-    if (col < 0) {
-        col = col + N;
-    } else if (col >= N) {
-        col = col - N;
+}
+
+// Computes cells of next generation into buf, halo of buf is not touched
+void step(const char* grid, char* buf, int N) {
+    for (int i = 0; i < N; ++i) {
+        const char* above = grid + toindex(i - 1, 0, N);
+        const char* row = grid + toindex(i, 0, N);
+        const char* below = grid + toindex(i + 1, 0, N);
+        char* out = buf + toindex(i, 0, N);
+        for (int j = 0; j < N; ++j) {
+            int alive_count = (above[j - 1] == ALIVE) + (above[j] == ALIVE) + (above[j + 1] == ALIVE) +
+                              (row[j - 1] == ALIVE) + (row[j + 1] == ALIVE) +
+                              (below[j - 1] == ALIVE) + (below[j] == ALIVE) + (below[j + 1] == ALIVE);
+            int alive = (alive_count == 3) | ((alive_count == 2) & (row[j] == ALIVE));
+            out[j] = alive ? ALIVE : DEAD;
+        }
     }
-    return row * N + col;
 }
 
 void printgrid(char* grid, char* buf, FILE* f, int N) {
     for (int i = 0; i < N; ++i) {
-        strncpy(buf, grid + i * N, N);
+        strncpy(buf, grid + toindex(i, 0, N), N);
         buf[N] = 0;
         fprintf(f, "%s\n", buf);
     }
@@ -38,35 +63,20 @@ int main(int argc, char* argv[]) {
     int iterations = atoi(argv[3]);
 
     FILE* input = fopen(argv[2], "r");
-    char* grid = (char*) malloc(N * N * sizeof(char));
+    // Row is read with its terminating zero, which lands in the right halo
+    char* grid = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
     for (int i = 0; i < N; ++i) {
-        fscanf(input, "%s", grid + i * N);
+        fscanf(input, "%s", grid + toindex(i, 0, N));
     }
     fclose(input);
 
-    char* buf = (char*) malloc(N * N * sizeof(char));
- 
+    char* buf = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
+
     for (int iter = 0; iter < iterations; ++iter) {
-        for (int i = 0; i < N; ++i) {
-            for (int j = 0; j < N; ++j) {
-                int alive_count = 0;
-                for (int di = -1; di <= 1; ++di) {
-                    for (int dj = -1; dj <= 1; ++dj) {
-                        if ((di != 0 || dj != 0) && grid[toindex(i + di, j + dj, N)] == ALIVE) {
-                            ++alive_count;
-                        }
-                    }
-                }
-                int current = i * N + j;
-                if (alive_count == 3 || (alive_count == 2 && grid[current] == ALIVE)) {
-                    buf[current] = ALIVE;
-                } else {
-                    buf[current] = DEAD;
-                }
-            }
-        }     
+        fillhalo(grid, N);
+        step(grid, buf, N);
         char* tmp = grid; grid = buf; buf = tmp;
-    }  
+    }
 
     FILE* output = fopen(argv[4], "w");
     printgrid(grid, buf, output, N);
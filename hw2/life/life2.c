@@ -6,7 +6,29 @@
 #define ALIVE 'X'
 #define DEAD '.'
 
+/*
+    Cells are kept in grid padded with halo rows and columns like in life.c,
+    so neighbours are counted at fixed offsets. Front marks, which are set
+    only around changed cells, stay in unpadded N x N array and wrap with
+    frontindex.
+*/
+
+// Position of cell (row, col), -1 <= row, col <= N, in padded grid
 int toindex(int row, int col, int N) {
+    return (row + 1) * (N + 2) + col + 1;
+}
+
+void fillhalo(char* grid, int N) {
+    memcpy(grid + toindex(-1, 0, N), grid + toindex(N - 1, 0, N), N);
+    memcpy(grid + toindex(N, 0, N), grid + toindex(0, 0, N), N);
+    for (int i = -1; i <= N; ++i) {
+        int wrapped = i < 0 ? N - 1 : (i == N ? 0 : i);
+        grid[toindex(i, -1, N)] = grid[toindex(wrapped, N - 1, N)];
+        grid[toindex(i, N, N)] = grid[toindex(wrapped, 0, N)];
+    }
+}
+
+int frontindex(int row, int col, int N) {
     if (row < 0) {
         row = row + N;
     } else if (row >= N) {
@@ -22,7 +44,7 @@ int toindex(int row, int col, int N) {
 
 void printgrid(char* grid, char* buf, FILE* f, int N) {
     for (int i = 0; i < N; ++i) {
-        strncpy(buf, grid + i * N, N);
+        strncpy(buf, grid + toindex(i, 0, N), N);
         buf[N] = 0;
         fprintf(f, "%s\n", buf);
     }
@@ -38,39 +60,37 @@ int main(int argc, char* argv[]) {
     int iterations = atoi(argv[3]);
 
     FILE* input = fopen(argv[2], "r");
-    char* grid = (char*) malloc(N * N * sizeof(char));
+    // Row is read with its terminating zero, which lands in the right halo
+    char* grid = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
     for (int i = 0; i < N; ++i) {
-        fscanf(input, "%s", grid + i * N);
+        fscanf(input, "%s", grid + toindex(i, 0, N));
     }
     fclose(input);
 
-    char* buf = (char*) malloc(N * N * sizeof(char));
+    char* buf = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
     char* front = (char*) malloc(N * N * sizeof(char));
     memset(front, 1, N * N);
 
     for (int iter = 0; iter < iterations; ++iter) {
         int next_front = (iter + 1) % 2 + 1;
+        fillhalo(grid, N);
         for (int i = 0; i < N; ++i) {
+            const char* above = grid + toindex(i - 1, 0, N);
+            const char* row = grid + toindex(i, 0, N);
+            const char* below = grid + toindex(i + 1, 0, N);
+            char* out = buf + toindex(i, 0, N);
             for (int j = 0; j < N; ++j) {
                 int current = i * N + j;
                 if (front[current] != 0) {
-                    int alive_count = 0;
-                    for (int di = -1; di <= 1; ++di) {
-                        for (int dj = -1; dj <= 1; ++dj) {
-                            if ((di != 0 || dj != 0) && grid[toindex(i + di, j + dj, N)] == ALIVE) {
-                                ++alive_count;
-                            }
-                        }
-                    }
-                    if (alive_count == 3 || (alive_count == 2 && grid[current] == ALIVE)) {
-                        buf[current] = ALIVE;
-                    } else {
-                        buf[current] = DEAD;
-                    }
-                    if (buf[current] != grid[current]) {
+                    int alive_count = (above[j - 1] == ALIVE) + (above[j] == ALIVE) + (above[j + 1] == ALIVE) +
+                                      (row[j - 1] == ALIVE) + (row[j + 1] == ALIVE) +
+                                      (below[j - 1] == ALIVE) + (below[j] == ALIVE) + (below[j + 1] == ALIVE);
+                    int alive = (alive_count == 3) | ((alive_count == 2) & (row[j] == ALIVE));
+                    out[j] = alive ? ALIVE : DEAD;
+                    if (out[j] != row[j]) {
                         for (int di = -1; di <= 1; ++di) {
                             for (int dj = -1; dj <= 1; ++dj) {
-                                front[toindex(i + di, j + dj, N)] = next_front;
+                                front[frontindex(i + di, j + dj, N)] = next_front;
                             }
                         }
                     } else {
@@ -80,7 +100,7 @@ int main(int argc, char* argv[]) {
                     }
                 }
             }
-        }     
+        }
         char* tmp = grid; grid = buf; buf = tmp;
     }  
 
@@ -1,10 +1,9 @@
 #include <cstdio>
 #include <cstdlib>
 #include <string.h>
-#include <ctime>
-#include <cmath>
+#include <iostream>
 #include <vector>
-#include <queue>
+#include <getopt.h>
 #include <mpi.h>
 
 #define ALIVE 'X'
@@ -13,366 +12,347 @@
 using std::cerr;
 using std::endl;
 
-struct cell
+/*
+	Processes form a periodic 2D Cartesian grid and each owns a tile of the
+	N x N torus, stored with one halo row and column on every side. Every
+	generation the halo is exchanged with the 8 neighbours in one message per
+	edge and corner. Messages are described by derived datatypes over the
+	tile, so cells are never copied or sent one by one. Process 0 reads the
+	grid, sends every process its tile in one message and gathers the tiles
+	back into the output file.
+
+	In overlap mode the exchange is only posted before the update. Cells at
+	least two rows and columns away from the tile edge don't read the halo
+	and are computed while messages are in flight, the boundary ring after
+	they arrive.
+*/
+
+enum Direction
 {
-	int w, h, value;
-	void print() const
-	{
-		cerr << "cell" << "(" << w << ", " << h << ", " << value << ")" << endl;
-	}
+	NORTH, SOUTH, WEST, EAST, NORTH_WEST, NORTH_EAST, SOUTH_WEST, SOUTH_EAST, DIRECTIONS
 };
 
-MPI::Datatype cell_type;
+const int kShift[DIRECTIONS][2] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}, {-1, -1}, {-1, 1}, {1, -1}, {1, 1}};
+const int kOpposite[DIRECTIONS] = {SOUTH, NORTH, EAST, WEST, SOUTH_EAST, SOUTH_WEST, NORTH_EAST, NORTH_WEST};
+
+const int kTileTag = DIRECTIONS;
 
-int toindex(int row, int col, int N) {
-  if (row < 0) {
-    row = row + N;
-  } else if (row >= N) {
-    row = row - N;
-  }
-  if (col < 0) {
-    col = col + N;
-  } else if (col >= N) {
-    col = col - N;
-  }
-  return row * N + col;
+// First row or column of block coord when N is split into blocks
+int blockBegin(int N, int coord, int blocks)
+{
+	return (long long) N * coord / blocks;
 }
 
-void printgrid(char* grid, FILE* f, int N) {
-  for (int i = 0; i < N; ++i) {
-  	for (int j = 0; j < N; ++j) {
-  		fprintf(f, "%c", grid[i * N + j]);
-  	}
-  	printf("\n");
-  }
+// rows x cols block of rowsTotal x colsTotal char matrix starting at (row, col)
+MPI_Datatype createBlockType(int rowsTotal, int colsTotal, int row, int col, int rows, int cols)
+{
+	int sizes[2] = {rowsTotal, colsTotal};
+	int subsizes[2] = {rows, cols};
+	int starts[2] = {row, col};
+	MPI_Datatype type;
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_CHAR, &type);
+	MPI_Type_commit(&type);
+	return type;
 }
 
 struct ProcessWorkInfo
 {
-	ProcessWorkInfo(int id, int N, int wChunks, int hChunks): id(id), N(N), wChunks(wChunks), hChunks(hChunks)
+	ProcessWorkInfo(MPI_Comm cart, int N, bool overlap): cart(cart), N(N), overlap(overlap)
 	{
-		wSize = (N + wChunks - 1) / wChunks;
-		hSize = (N + hChunks - 1) / hChunks;
-		int wPos, hPos;
-		getPosById(id, wPos, hPos);
-		uH = hPos * hSize;
-		dH = std::min(uH + hSize, N);
-		lW = wPos * wSize;
-		rW = std::min(lW + wSize, N);
+		int dims[2], periods[2], coords[2];
+		MPI_Cart_get(cart, 2, dims, periods, coords);
+		uH = blockBegin(N, coords[0], dims[0]);
+		dH = blockBegin(N, coords[0] + 1, dims[0]);
+		lW = blockBegin(N, coords[1], dims[1]);
+		rW = blockBegin(N, coords[1] + 1, dims[1]);
 		myHSize = dH - uH;
 		myWSize = rW - lW;
-		cerr << id << ": " << "My size: " << "(" << myHSize << ", " << myWSize << ")" << endl;
-		cerr << id << ": " << "My cell: " << "(" << hPos << ", " << wPos << ")" << endl;
-		cerr << id << ": " << "My box: (" << uH << ", " << lW << ") (" << dH << ", " << rW << ")" << endl;
-		int size = (myWSize + 2) * (myHSize + 2);
-		cerr << id << ": " << "size = " << size << endl;
-		grid = (char*) malloc(size * sizeof(char));
-		buf = (char*) malloc(size * sizeof(char));
-		cerr << id << ": " << "Receiving grid" << endl;
-		for (int h = uH - 1; h < dH + 1; ++h)
+		width = myWSize + 2;
+		grid.assign((myHSize + 2) * width, DEAD);
+		buf.assign((myHSize + 2) * width, DEAD);
+
+		interiorType = createBlockType(myHSize + 2, width, 1, 1, myHSize, myWSize);
+		for (int d = 0; d < DIRECTIONS; ++d)
 		{
-			for (int w = lW - 1; w < rW + 1; ++w)
+			int neighbourCoords[2] = {coords[0] + kShift[d][0], coords[1] + kShift[d][1]};
+			MPI_Cart_rank(cart, neighbourCoords, &neighbours[d]);
+			// Edge or corner of own cells goes out, halo next to it comes in
+			int sendStart[2], recvStart[2], count[2];
+			int size[2] = {myHSize, myWSize};
+			for (int k = 0; k < 2; ++k)
 			{
-				int nh = h;
-				int nw = w;
-				int cellID = cellId(nh, nw);
-				if (cellID >= size)
-				{
-					cerr << id << ": " << "Bad cell id " << cellID << ": " << "(" << h << ", " << w << ")" << endl;
-					continue;
-				}
-				requests.push(MPI::COMM_WORLD.Irecv(grid + cellID, 1, MPI::UNSIGNED_CHAR, 0, 0));
+				count[k] = kShift[d][k] == 0 ? size[k] : 1;
+				sendStart[k] = kShift[d][k] > 0 ? size[k] : 1;
+				recvStart[k] = kShift[d][k] == 0 ? 1 : (kShift[d][k] > 0 ? size[k] + 1 : 0);
 			}
+			sendTypes[d] = createBlockType(myHSize + 2, width, sendStart[0], sendStart[1], count[0], count[1]);
+			recvTypes[d] = createBlockType(myHSize + 2, width, recvStart[0], recvStart[1], count[0], count[1]);
 		}
-		while (!requests.empty())
-		{
-			requests.front().Wait();
-			requests.pop();
-		}
-		cerr << id << ": " << "Grid received" << endl;
 	}
 
 	~ProcessWorkInfo()
 	{
-		free(grid);
-		free(buf);
+		MPI_Type_free(&interiorType);
+		for (int d = 0; d < DIRECTIONS; ++d)
+		{
+			MPI_Type_free(&sendTypes[d]);
+			MPI_Type_free(&recvTypes[d]);
+		}
 	}
 
-	void updateGrid()
+	// Message to neighbour in direction d is tagged d, so neighbours met in
+	// several directions, e.g. on 1 x P grid, are told apart
+	void postHalo()
 	{
-		for (int j = lW - 1; j < rW + 1; ++j)
+		for (int d = 0; d < DIRECTIONS; ++d)
 		{
-			recvCell(uH - 1, j);
-			recvCell(dH, j);
+			MPI_Irecv(grid.data(), 1, recvTypes[d], neighbours[d], kOpposite[d], cart, &requests[d]);
 		}
-		for (int i = uH - 1; i < dH + 1; ++i)
+		for (int d = 0; d < DIRECTIONS; ++d)
 		{
-			recvCell(i, lW - 1);
-			recvCell(i, rW);
+			MPI_Isend(grid.data(), 1, sendTypes[d], neighbours[d], d, cart, &requests[DIRECTIONS + d]);
 		}
-
-    for (int i = uH; i < dH; ++i) 
-    {
-      for (int j = lW; j < rW; ++j) 
-      {
-        int alive_count = 0;
-        for (int di = -1; di <= 1; ++di) 
-        {
-          for (int dj = -1; dj <= 1; ++dj) 
-          {
-            if ((di != 0 || dj != 0) && grid[cellId(i + di, j + dj)] == ALIVE) 
-            {
-              ++alive_count;
-            }
-          }
-        }
-        int current = cellId(i, j);
-        if (alive_count == 3 || (alive_count == 2 && grid[current] == ALIVE)) 
-        {
-          buf[current] = ALIVE;
-        } else {
-          buf[current] = DEAD;
-        }
-
-        sendIfRequired(i, j, buf[current]);
-      }
-    }     
-    cerr << id << ": " << "Sended " << sendRequests.size() << endl;
-    cerr << id << ": " << "Waiting for " << recvRequests.size() << endl;
-    while (!recvRequests.empty())
-    {
-    	recvRequests.front().first.Wait();
-    	cell C = *recvRequests.front().second;
-    	buf[cellId(C.h, C.w)] = C.value;
-    	recvRequests.pop();
-    }
-    while (!sendRequests.empty())
-    {
-    	sendRequests.front().Wait();
-    	sendRequests.pop();
-    }
-
-   	char* tmp;
-   	tmp = grid;
-   	grid = buf;
-   	buf = tmp; 
 	}
 
-	void sendIfRequired(int i, int j, char value)
+	void waitHalo()
 	{
-    for (int di = -1; di <= 1; ++di) 
-    {
-      for (int dj = -1; dj <= 1; ++dj) 
-      {
-      	int ni = i + di;
-      	int nj = j + dj;
-      	if ((ni < uH) || (ni >= dH) || (nj < lW) || (nj >= rW))
-      	{
-      		sendCell(i, j, di, dj, value);
-      	}
-      }
-    }
-  }
-
-  void normalize(int& i, int& j) const
-  {
-  	if (i < 0)
-  		i += N;
-  	if (j < 0)
-  		j += N;
-
-  	if (i >= N)
-  		i -= N;
-  	if (j >= N)
-  		j -= N;
-  }
+		MPI_Waitall(2 * DIRECTIONS, requests, MPI_STATUSES_IGNORE);
+	}
 
-  void sendCell(int i, int j, int di, int dj, char value)
-  {
-  	int ni = i + di;
-  	int nj = i + dj;
-  	normalize(ni, nj);
-  	int dest = getProcessIdByCell(ni, nj);
-  	cell* C = new cell();
-  	C->h = i;
-  	C->w = j;
-  	C->value = value;
-  	if (dest != id)
-  	{
-	  	sendRequests.push(MPI::COMM_WORLD.Isend(C, 1, cell_type, dest, 0));
-  	}
-  }
+	// Lets MPI progress messages which wait for the other side
+	void progressHalo()
+	{
+		int done;
+		MPI_Testall(2 * DIRECTIONS, requests, &done, MPI_STATUSES_IGNORE);
+	}
 
-  void recvCell(int i, int j)
-  {
-  	normalize(i, j);
-  	int source = getProcessIdByCell(i, j);
-  	std::pair<MPI::Request, cell*> request;
-  	request.second = new cell();
-  	if (source != id)
-  	{
-	  	request.first = MPI::COMM_WORLD.Irecv(request.second, 1, cell_type, source, 0);
-	  	recvRequests.push(request);
-  	}
-  }
+	// Updates columns [first, last) of tile row i, 1 <= i <= myHSize
+	void updateCells(int i, int first, int last)
+	{
+		const char* above = grid.data() + (i - 1) * width;
+		const char* row = grid.data() + i * width;
+		const char* below = grid.data() + (i + 1) * width;
+		char* out = buf.data() + i * width;
+		for (int j = first; j < last; ++j)
+		{
+			int alive_count = (above[j - 1] == ALIVE) + (above[j] == ALIVE) + (above[j + 1] == ALIVE) +
+			                  (row[j - 1] == ALIVE) + (row[j + 1] == ALIVE) +
+			                  (below[j - 1] == ALIVE) + (below[j] == ALIVE) + (below[j + 1] == ALIVE);
+			int alive = (alive_count == 3) | ((alive_count == 2) & (row[j] == ALIVE));
+			out[j] = alive ? ALIVE : DEAD;
+		}
+	}
 
-	int cellId(int h, int w) const
+	void updateGrid()
 	{
-		if (h - (uH - 1) < 0)
+		postHalo();
+		if (!overlap)
 		{
-			h += N;
+			waitHalo();
+			for (int i = 1; i <= myHSize; ++i)
+			{
+				updateCells(i, 1, myWSize + 1);
+			}
+			grid.swap(buf);
+			return;
 		}
-		if (h > dH)
+
+		for (int i = 2; i < myHSize; ++i)
 		{
-			h -= N;
-		}	
-		if (w  - (lW - 1) < 0)
+			updateCells(i, 2, myWSize);
+			progressHalo();
+		}
+		waitHalo();
+		updateCells(1, 1, myWSize + 1);
+		if (myHSize > 1)
 		{
-			w += N;
+			updateCells(myHSize, 1, myWSize + 1);
 		}
-		if (w > rW)
+		for (int i = 2; i < myHSize; ++i)
 		{
-			w -= N;
+			updateCells(i, 1, 2);
+			if (myWSize > 1)
+			{
+				updateCells(i, myWSize, myWSize + 1);
+			}
 		}
-		return (h - (uH - 1)) * (wSize + 1) + (w - (lW - 1));
+		grid.swap(buf);
 	}
 
-	void getPosById(int id, int& wPos, int& hPos) const
+	MPI_Comm cart;
+	int N;
+	bool overlap;
+	int uH, dH, lW, rW;
+	int myWSize, myHSize;
+	int width;
+	std::vector<char> grid;
+	std::vector<char> buf;
+	int neighbours[DIRECTIONS];
+	MPI_Datatype sendTypes[DIRECTIONS];
+	MPI_Datatype recvTypes[DIRECTIONS];
+	MPI_Datatype interiorType;
+	MPI_Request requests[2 * DIRECTIONS];
+};
+
+// Tile of process with given rank in the whole N x N grid
+MPI_Datatype createTileType(MPI_Comm cart, int rank, int N)
+{
+	int dims[2], periods[2], coords[2];
+	MPI_Cart_get(cart, 2, dims, periods, coords);
+	MPI_Cart_coords(cart, rank, 2, coords);
+	int uH = blockBegin(N, coords[0], dims[0]);
+	int lW = blockBegin(N, coords[1], dims[1]);
+	return createBlockType(N, N, uH, lW, blockBegin(N, coords[0] + 1, dims[0]) - uH,
+	                       blockBegin(N, coords[1] + 1, dims[1]) - lW);
+}
+
+int main(int argc, char* argv[]) {
+	MPI_Init(&argc, &argv);
+	int id, num_procs;
+	MPI_Comm_rank(MPI_COMM_WORLD, &id);
+	MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
+
+	bool overlap = false;
+	static const struct option long_options[] = {
+		{"overlap", no_argument, nullptr, 'o'},
+		{nullptr, 0, nullptr, 0}
+	};
+	int option;
+	bool options_valid = true;
+	while ((option = getopt_long(argc, argv, "", long_options, nullptr)) != -1)
 	{
-		hPos = (id - 1) / wChunks;
-		wPos = (id - 1) % wChunks;
+		overlap |= option == 'o';
+		options_valid &= option == 'o';
 	}
-
-	int getProcessIdByCell(int w, int h) const
+	if (!options_valid || argc - optind != 4)
 	{
-		int wPos = w / wSize;
-		int hPos = h / hSize;
-		return idByPos(wPos, hPos);
+		if (id == 0)
+		{
+			fprintf(stderr, "Usage: %s [--overlap] N input_file iterations output_file\n", argv[0]);
+			fprintf(stderr, "  --overlap  compute tile interior while halo is exchanged\n");
+		}
+		MPI_Finalize();
+		return 1;
 	}
-
-	int idByPos(int wPos, int hPos) const
+	argv += optind - 1;
+	int N = atoi(argv[1]); // grid size
+	int iterations = atoi(argv[3]);
+
+	int dims[2] = {0, 0};
+	int periods[2] = {1, 1};
+	MPI_Dims_create(num_procs, 2, dims);
+	if (N < dims[0] || N < dims[1])
 	{
-		return hPos * wChunks + wPos + 1;
+		if (id == 0)
+		{
+			cerr << "Error: grid " << N << " x " << N << " is too small for " << dims[0] << " x "
+			     << dims[1] << " processes" << endl;
+		}
+		MPI_Finalize();
+		return 1;
 	}
+	MPI_Comm cart;
+	MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &cart);
 
-	int id;
-	int uH, dH, lW, rW;
-	int N, wChunks, hChunks;
-	int wSize, hSize;
-	int myWSize, myHSize;
-	char* grid;
-	char* buf;
-	std::queue<MPI::Request> requests;
-	std::queue<MPI::Request> sendRequests;
-	std::queue<std::pair<MPI::Request, cell*>> recvRequests;
-};
-
-int main(int argc, char* argv[]) {
-  int id, num_procs;
-
-  MPI::Init(argc, argv);
-  id = MPI::COMM_WORLD.Get_rank();
-  num_procs = MPI::COMM_WORLD.Get_size();
-
-  cell_type = MPI::INT.Create_contiguous(3);
-  cell_type.Commit();
-
-  int wChunks = sqrt(num_procs - 1);
-  int hChunks = (num_procs - 1) / wChunks;
-  int working_procs = wChunks * hChunks;
-
-  if (id == 0) 
-  {
-	  cerr << "Working processes " << working_procs << endl;
-		cerr << "Hello, I am master process " << id << endl;
-	  if (argc != 5) 
-	  {
-	    fprintf(stderr, "Usage: %s N input_file iterations output_file\n", argv[0]);
-	    return 1;
-	  }
-
-	  int N = atoi(argv[1]); // grid size
-	  int iterations = atoi(argv[3]);
-
-	  FILE* input = fopen(argv[2], "r");
-	  char* grid = (char*) malloc(N * N * sizeof(char));
-	  for (int i = 0; i < N; ++i) 
-	  {
-	    fscanf(input, "%s", grid + i * N);
-	  }
-	  fclose(input);
-
-	  cerr << id << ": " << "Successfully finished reading input" << endl;
-
-  	for (int proc = 1; proc <= working_procs; ++proc)
-  	{
-	  	MPI::COMM_WORLD.Send(&iterations, 1, MPI::INT, proc, 0);
-	  	MPI::COMM_WORLD.Send(&N, 1, MPI::INT, proc, 0);
-  	}
+	// Whole grid lives only on process 0
+	std::vector<char> whole;
+	int ok = 1;
+	if (id == 0)
+	{
+		whole.resize(N * N);
+		FILE* input = fopen(argv[2], "r");
+		if (input == NULL)
+		{
+			cerr << "Error: input file could not be opened" << endl;
+			ok = 0;
+		}
+		// Width bound reads one extra cell, so longer rows are detected
+		// instead of overflowing the row buffer
+		std::vector<char> row(N + 2);
+		char format[32];
+		snprintf(format, sizeof(format), "%%%ds", N + 1);
+		for (int i = 0; input != NULL && i < N && ok; ++i)
+		{
+			ok = fscanf(input, format, row.data()) == 1 && (int) strlen(row.data()) == N;
+			if (!ok)
+			{
+				cerr << "Error: expected " << N << " rows of " << N << " cells" << endl;
+			}
+			else
+			{
+				memcpy(whole.data() + i * N, row.data(), N);
+			}
+		}
+		if (input != NULL)
+		{
+			fclose(input);
+		}
+	}
+	MPI_Bcast(&ok, 1, MPI_INT, 0, cart);
+	if (!ok)
+	{
+		MPI_Comm_free(&cart);
+		MPI_Finalize();
+		return 1;
+	}
 
-  	for (int proc = 1; proc <= working_procs; ++proc) 
-  	{
-			int wSize = (N + wChunks - 1) / wChunks;
-			int hSize = (N + hChunks - 1) / hChunks;
-			int hPos = (proc - 1) / wChunks;
-			int wPos = (proc - 1) % wChunks;
-			int uH = hPos * hSize;
-			int dH = std::min(uH + hSize, N);
-			int lW = wPos * wSize;
-			int rW = std::min(lW + wSize, N);
-			hSize = dH - uH;
-			wSize = rW - lW;
-			
-			std::queue<MPI::Request> requests;
-			int totalSent = 0;
-			for (int h = uH - 1; h < dH + 1; ++h)
+	{
+		ProcessWorkInfo processWorkInfo(cart, N, overlap);
+		if (id == 0)
+		{
+			for (int proc = 0; proc < num_procs; ++proc)
 			{
-				for (int w = lW - 1; w < rW + 1; ++w)
+				MPI_Datatype tileType = createTileType(cart, proc, N);
+				if (proc == 0)
 				{
-					++totalSent;
-					requests.push(MPI::COMM_WORLD.Isend(grid + toindex(h, w, N), 1, MPI::UNSIGNED_CHAR, proc, 0));
+					MPI_Sendrecv(whole.data(), 1, tileType, 0, kTileTag, processWorkInfo.grid.data(), 1,
+					             processWorkInfo.interiorType, 0, kTileTag, cart, MPI_STATUS_IGNORE);
+				} else {
+					MPI_Send(whole.data(), 1, tileType, proc, kTileTag, cart);
 				}
+				MPI_Type_free(&tileType);
 			}
-			while (!requests.empty())
-			{
-				requests.front().Wait();
-				requests.pop();
-			}
-			cerr << id << ": " << "Grid to " << proc << " was sent" << endl;
-			cerr << id << ": " << "Total sent: " << totalSent << endl;
-  	}
+		} else {
+			MPI_Recv(processWorkInfo.grid.data(), 1, processWorkInfo.interiorType, 0, kTileTag, cart,
+			         MPI_STATUS_IGNORE);
+		}
 
-	  // Gather everything here
-	  // FILE* output = fopen(argv[4], "w");
-	  // printgrid(grid, output, N);
-	  // fclose(output);
+		for (int iter = 0; iter < iterations; ++iter) {
+			processWorkInfo.updateGrid();
+		}
 
-	  // free(grid);
-  }
-  else
-  if (id <= working_procs)
-  {
-  	cerr << "Hello, I am process " << id << endl;
-  	int iterations;
-  	int N;
-		MPI::COMM_WORLD.Recv(&iterations, 1, MPI::INT, 0, 0);
-		cerr << id << ": " << "Received iterations = " << iterations << endl;
-		MPI::COMM_WORLD.Recv(&N, 1, MPI::INT, 0, 0);
-		cerr << id << ": " << "Received N = " << N << endl;
+		if (id == 0)
+		{
+			for (int proc = 0; proc < num_procs; ++proc)
+			{
+				MPI_Datatype tileType = createTileType(cart, proc, N);
+				if (proc == 0)
+				{
+					MPI_Sendrecv(processWorkInfo.grid.data(), 1, processWorkInfo.interiorType, 0, kTileTag,
+					             whole.data(), 1, tileType, 0, kTileTag, cart, MPI_STATUS_IGNORE);
+				} else {
+					MPI_Recv(whole.data(), 1, tileType, proc, kTileTag, cart, MPI_STATUS_IGNORE);
+				}
+				MPI_Type_free(&tileType);
+			}
+		} else {
+			MPI_Send(processWorkInfo.grid.data(), 1, processWorkInfo.interiorType, 0, kTileTag, cart);
+		}
+	}
 
-  	ProcessWorkInfo processWorkInfo(id, N, wChunks, hChunks);
-	  for (int iter = 0; iter < iterations; ++iter) {
-	  	processWorkInfo.updateGrid();
-	  	cerr << id << ": " << "Iteration " << iter << " finished" << endl;
-	  }
-	  // processWorkInfo.sendBack();
-  }
-  else
-  {
-  	return 0;
-  }
+	if (id == 0)
+	{
+		FILE* output = fopen(argv[4], "w");
+		for (int i = 0; i < N; ++i)
+		{
+			fwrite(whole.data() + i * N, 1, N, output);
+			fputc('\n', output);
+		}
+		fclose(output);
+	}
 
-  MPI::Finalize();
+	MPI_Comm_free(&cart);
+	MPI_Finalize();
 
-  return 0;
-}
\ No newline at end of file
+	return 0;
+}
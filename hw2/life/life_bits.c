@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIVE 'X'
+#define DEAD '.'
+
+/*
+    Bit-packed Game of Life on N x N torus. Cell j of a row is bit j % 64 of
+    word j / 64, so a row takes W = ceil(N / 64) words and the grid is 8 times
+    smaller than one char per cell. Rows are padded with a ghost word on both
+    sides and the grid with a ghost row above and below. Before every
+    generation the ghosts receive the wrapped around neighbours, so the update
+    is the same branch-free word loop everywhere. Within a word all 64 cells
+    are updated at once: neighbours are the row words shifted by one bit and
+    counted with bit-sliced adders. The loop has no dependencies between
+    words and is vectorized by the compiler.
+*/
+
+typedef uint64_t word;
+
+#define WORD_BITS 64
+
+// Packs row of N 'X'/'.' chars into W words, unused bits are zero
+void packrow(const char* cells, word* row, int N, int W) {
+    memset(row, 0, W * sizeof(word));
+    for (int j = 0; j < N; ++j) {
+        if (cells[j] == ALIVE) {
+            row[j / WORD_BITS] |= (word) 1 << (j % WORD_BITS);
+        }
+    }
+}
+
+void unpackrow(const word* row, char* cells, int N) {
+    for (int j = 0; j < N; ++j) {
+        cells[j] = (row[j / WORD_BITS] >> (j % WORD_BITS)) & 1 ? ALIVE : DEAD;
+    }
+    cells[N] = 0;
+}
+
+// Fills ghost words and rows of padded grid with rows 1..N and words 1..W
+void fillhalo(word* grid, int N, int W) {
+    int stride = W + 2;
+    int tail = N % WORD_BITS;
+    memcpy(grid, grid + N * stride, stride * sizeof(word));
+    memcpy(grid + (N + 1) * stride, grid + stride, stride * sizeof(word));
+    for (int i = 0; i < N + 2; ++i) {
+        word* row = grid + i * stride;
+        word first = row[1] & 1;
+        word last = (row[1 + (N - 1) / WORD_BITS] >> ((N - 1) % WORD_BITS)) & 1;
+        // West neighbour of cell 0 is the top bit of the left ghost, east
+        // neighbour of cell N - 1 is the bit right after it
+        row[0] = last << (WORD_BITS - 1);
+        if (tail == 0) {
+            row[W + 1] = first;
+        } else {
+            row[W] = (row[W] & (((word) 1 << tail) - 1)) | (first << tail);
+            row[W + 1] = 0;
+        }
+    }
+}
+
+// Computes rows 1..N of next from padded grid
+void step(const word* grid, word* next, int N, int W) {
+    int stride = W + 2;
+    int tail = N % WORD_BITS;
+    word tail_mask = tail == 0 ? ~(word) 0 : ((word) 1 << tail) - 1;
+    for (int i = 1; i <= N; ++i) {
+        const word* above = grid + (i - 1) * stride;
+        const word* middle = grid + i * stride;
+        const word* below = grid + (i + 1) * stride;
+        word* out = next + i * stride;
+        for (int w = 1; w <= W; ++w) {
+            word a = above[w];
+            word a_w = (a << 1) | (above[w - 1] >> (WORD_BITS - 1));
+            word a_e = (a >> 1) | (above[w + 1] << (WORD_BITS - 1));
+            word b = middle[w];
+            word b_w = (b << 1) | (middle[w - 1] >> (WORD_BITS - 1));
+            word b_e = (b >> 1) | (middle[w + 1] << (WORD_BITS - 1));
+            word c = below[w];
+            word c_w = (c << 1) | (below[w - 1] >> (WORD_BITS - 1));
+            word c_e = (c >> 1) | (below[w + 1] << (WORD_BITS - 1));
+
+            // Ones and twos of every row's neighbours
+            word a1 = a_w ^ a ^ a_e;
+            word a2 = (a_w & a) | (a_e & (a_w ^ a));
+            word b1 = b_w ^ b_e;
+            word b2 = b_w & b_e;
+            word c1 = c_w ^ c ^ c_e;
+            word c2 = (c_w & c) | (c_e & (c_w ^ c));
+            // Count is ones + 2 * (a2 + b2 + c2 + carry of ones)
+            word ones = a1 ^ b1 ^ c1;
+            word carry = (a1 & b1) | (c1 & (a1 ^ b1));
+            word t1 = a2 ^ b2;
+            word t2 = c2 ^ carry;
+            word pairs = (a2 & b2) | (c2 & carry) | (t1 & t2);
+            // Exactly one twos bit means count is 2 + ones
+            word two_or_three = (t1 ^ t2) & ~pairs;
+            out[w] = two_or_three & (ones | b);
+        }
+        out[W] &= tail_mask;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s N input_file iterations output_file\n", argv[0]);
+        return 1;
+    }
+
+    int N = atoi(argv[1]); // grid size
+    int iterations = atoi(argv[3]);
+    int W = (N + WORD_BITS - 1) / WORD_BITS;
+    int stride = W + 2;
+
+    FILE* input = fopen(argv[2], "r");
+    if (input == NULL) {
+        fprintf(stderr, "Error: input file could not be opened\n");
+        return 1;
+    }
+    word* grid = (word*) calloc((size_t) (N + 2) * stride, sizeof(word));
+    word* next = (word*) calloc((size_t) (N + 2) * stride, sizeof(word));
+    char* line = (char*) malloc(N + 1);
+    for (int i = 0; i < N; ++i) {
+        if (fscanf(input, "%s", line) != 1 || (int) strlen(line) != N) {
+            fprintf(stderr, "Error: expected %d rows of %d cells\n", N, N);
+            return 1;
+        }
+        packrow(line, grid + (i + 1) * stride + 1, N, W);
+    }
+    fclose(input);
+
+    for (int iter = 0; iter < iterations; ++iter) {
+        fillhalo(grid, N, W);
+        step(grid, next, N, W);
+        word* tmp = grid; grid = next; next = tmp;
+    }
+
+    FILE* output = fopen(argv[4], "w");
+    for (int i = 0; i < N; ++i) {
+        unpackrow(grid + (i + 1) * stride + 1, line, N);
+        fprintf(output, "%s\n", line);
+    }
+    fclose(output);
+
+    free(grid);
+    free(next);
+    free(line);
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIVE 'X'
+#define DEAD '.'
+
+/*
+    OpenMP version of life.c. Grid is padded with halo rows and columns
+    holding the wrapped around neighbours, and rows are split between threads
+    in static blocks. Both grids are first filled by the same static schedule,
+    so on NUMA machines every thread's rows are placed on its own socket.
+    One parallel region runs all generations: one thread refreshes the halo,
+    all update their rows, and the grids are swapped between barriers.
+*/
+
+// Position of cell (row, col), -1 <= row, col <= N, in padded grid
+int toindex(int row, int col, int N) {
+    return (row + 1) * (N + 2) + col + 1;
+}
+
+void fillhalo(char* grid, int N) {
+    memcpy(grid + toindex(-1, 0, N), grid + toindex(N - 1, 0, N), N);
+    memcpy(grid + toindex(N, 0, N), grid + toindex(0, 0, N), N);
+    for (int i = -1; i <= N; ++i) {
+        int wrapped = i < 0 ? N - 1 : (i == N ? 0 : i);
+        grid[toindex(i, -1, N)] = grid[toindex(wrapped, N - 1, N)];
+        grid[toindex(i, N, N)] = grid[toindex(wrapped, 0, N)];
+    }
+}
+
+void steprow(const char* grid, char* buf, int i, int N) {
+    const char* above = grid + toindex(i - 1, 0, N);
+    const char* row = grid + toindex(i, 0, N);
+    const char* below = grid + toindex(i + 1, 0, N);
+    char* out = buf + toindex(i, 0, N);
+    for (int j = 0; j < N; ++j) {
+        int alive_count = (above[j - 1] == ALIVE) + (above[j] == ALIVE) + (above[j + 1] == ALIVE) +
+                          (row[j - 1] == ALIVE) + (row[j + 1] == ALIVE) +
+                          (below[j - 1] == ALIVE) + (below[j] == ALIVE) + (below[j + 1] == ALIVE);
+        int alive = (alive_count == 3) | ((alive_count == 2) & (row[j] == ALIVE));
+        out[j] = alive ? ALIVE : DEAD;
+    }
+}
+
+void printgrid(char* grid, char* buf, FILE* f, int N) {
+    for (int i = 0; i < N; ++i) {
+        strncpy(buf, grid + toindex(i, 0, N), N);
+        buf[N] = 0;
+        fprintf(f, "%s\n", buf);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s N input_file iterations output_file\n", argv[0]);
+        return 1;
+    }
+
+    int N = atoi(argv[1]); // grid size
+    int iterations = atoi(argv[3]);
+
+    char* grid = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
+    char* buf = (char*) malloc((N + 2) * (N + 2) * sizeof(char));
+    // First touch of rows by the threads which update them
+    memset(grid + toindex(-1, -1, N), DEAD, N + 2);
+    memset(buf + toindex(-1, -1, N), DEAD, N + 2);
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < N; ++i) {
+        memset(grid + toindex(i, -1, N), DEAD, N + 2);
+        memset(buf + toindex(i, -1, N), DEAD, N + 2);
+    }
+    memset(grid + toindex(N, -1, N), DEAD, N + 2);
+    memset(buf + toindex(N, -1, N), DEAD, N + 2);
+
+    FILE* input = fopen(argv[2], "r");
+    // Row is read with its terminating zero, which lands in the right halo
+    for (int i = 0; i < N; ++i) {
+        fscanf(input, "%s", grid + toindex(i, 0, N));
+    }
+    fclose(input);
+
+    #pragma omp parallel
+    {
+        for (int iter = 0; iter < iterations; ++iter) {
+            #pragma omp single
+            fillhalo(grid, N);
+            #pragma omp for schedule(static)
+            for (int i = 0; i < N; ++i) {
+                steprow(grid, buf, i, N);
+            }
+            #pragma omp single
+            {
+                char* tmp = grid; grid = buf; buf = tmp;
+            }
+        }
+    }
+
+    FILE* output = fopen(argv[4], "w");
+    printgrid(grid, buf, output, N);
+    fclose(output);
+
+    free(grid);
+    free(buf);
+
+    return 0;
+}